@@ -35,7 +35,8 @@
 #include <lower_mac/tetra_interleave.h>
 #include <lower_mac/tetra_scramb.h>
 #include <lower_mac/tetra_rm3014.h>
-#include <lower_mac/viterbi.h>
+#include <lower_mac/viterbi_k5.h>
+#include <lower_mac/viterbi_cch.h>
 #include <phy/tetra_burst.h>
 #include "testpdu.h"
 
@@ -45,19 +46,25 @@
 static unsigned int num_crc_err;
 
 /* incoming TP-SAP UNITDATA.ind  from PHY into lower MAC */
-void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned int len, void *priv)
+void tp_sap_udata_ind(enum tp_sap_data_type type, const int8_t *bits, unsigned int len, void *priv)
 {
 }
 
 /* incoming DP-SAP UNITDATA.ind  from PHY into lower MAC */
-void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned int len, void *priv)
+void dp_sap_udata_ind(enum dp_sap_data_type type, const int8_t *bits, unsigned int len, void *priv)
+{
+}
+
+void tp_sap_udata_ind_batch(const struct tetra_sap_blk *blks, unsigned int count, void *priv)
 {
 }
 
 static void decode_schf(const uint8_t *bits)
 {
 	uint8_t type4[1024];
-	uint8_t type3dp[1024*4];
+	int8_t type3dp[1024*4];
+	uint16_t mother_pos[432];
+	int i;
 	uint8_t type3[1024];
 	uint8_t type2[1024];
 
@@ -68,11 +75,13 @@ static void decode_schf(const uint8_t *bits)
 	/* Run (120,11) block deinterleaving: type-3 bits */
 	block_deinterleave(432, 103, type4, type3);
 	printf("SCH/F type3: %s\n", osmo_ubit_dump(type3, 432));
-	/* De-puncture */
-	memset(type3dp, 0xff, sizeof(type3dp));
-	tetra_rcpc_depunct(TETRA_RCPC_PUNCT_2_3, type3, 432, type3dp);
-	printf("SCH/F type3dp: %s\n", osmo_ubit_dump(type3dp, 288*4));
-	viterbi_dec_sb1_wrapper(type3dp, type2, 288);
+	/* De-puncture into soft bits, punctured ones are erasures */
+	memset(type3dp, 0, sizeof(type3dp));
+	tetra_rcpc_depunct_positions(TETRA_RCPC_PUNCT_2_3, 432, mother_pos);
+	for (i = 0; i < 432; i++)
+		type3dp[mother_pos[i]] = tetra_ubit2sbit(type3[i]);
+	printf("SCH/F type3dp: %s\n", osmo_hexdump((uint8_t *) type3dp, 288*4));
+	conv_cch_decode(type3dp, type2, 288);
 	printf("SCH/F type2: %s\n", osmo_ubit_dump(type2, 288));
 
 	{
@@ -164,7 +173,9 @@ int build_ndb_schf()
 static void decode_sb1(const uint8_t *bits)
 {
 	uint8_t type4[1024];
-	uint8_t type3dp[1024*4];
+	int8_t type3dp[1024*4];
+	uint16_t mother_pos[120];
+	int i;
 	uint8_t type3[1024];
 	uint8_t type2[1024];
 
@@ -175,11 +186,13 @@ static void decode_sb1(const uint8_t *bits)
 	/* Run (120,11) block deinterleaving: type-3 bits */
 	block_deinterleave(120, 11, type4, type3);
 	printf("SB1 type3: %s\n", osmo_ubit_dump(type3, 120));
-	/* De-puncture */
-	memset(type3dp, 0xff, sizeof(type3dp));
-	tetra_rcpc_depunct(TETRA_RCPC_PUNCT_2_3, type3, 120, type3dp);
-	printf("SB1 type3dp: %s\n", osmo_ubit_dump(type3dp, 80*4));
-	viterbi_dec_sb1_wrapper(type3dp, type2, 80);
+	/* De-puncture into soft bits, punctured ones are erasures */
+	memset(type3dp, 0, sizeof(type3dp));
+	tetra_rcpc_depunct_positions(TETRA_RCPC_PUNCT_2_3, 120, mother_pos);
+	for (i = 0; i < 120; i++)
+		type3dp[mother_pos[i]] = tetra_ubit2sbit(type3[i]);
+	printf("SB1 type3dp: %s\n", osmo_hexdump((uint8_t *) type3dp, 80*4));
+	conv_cch_decode(type3dp, type2, 80);
 	printf("SB1 type2: %s\n", osmo_ubit_dump(type2, 80));
 
 	{
@@ -309,6 +322,262 @@ int build_sb()
 	return 0;
 }
 
+/* every pattern of up to RM3014_MAX_ERRORS bit errors must be corrected,
+ * by the hard as well as by the soft decoder */
+static int rm3014_test(void)
+{
+	int8_t sbits[30];
+	uint16_t info, out;
+	uint32_t word, err;
+	int i, j, n;
+
+	srand(1);
+	for (n = 0; n < 10000; n++) {
+		info = rand() & 0x3fff;
+		word = tetra_rm3014_compute(info);
+
+		err = 0;
+		for (i = 0; i < n % (RM3014_MAX_ERRORS + 1); i++)
+			err |= 1 << (rand() % 30);
+		word ^= err;
+
+		if (tetra_rm3014_decode(word, &out) != __builtin_popcount(err) || out != info) {
+			printf("RM3014 hard decode of 0x%04x with errors 0x%08x failed\n", info, err);
+			return -1;
+		}
+
+		for (j = 0; j < 30; j++)
+			sbits[j] = (word >> (29 - j)) & 1 ? -127 : 127;
+		if (tetra_rm3014_decode_soft(sbits, &out) != __builtin_popcount(err) || out != info) {
+			printf("RM3014 soft decode of 0x%04x with errors 0x%08x failed\n", info, err);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* SB1 sized blocks: 60 type-1 bits, the CRC and 4 tail bits */
+#define LIST_TEST_BITS	(60 + 16)
+#define LIST_TEST_PATHS	16
+
+struct list_test_state {
+	const uint8_t *sent;
+	uint8_t cand[LIST_TEST_PATHS + 1][LIST_TEST_BITS];
+	unsigned int num;
+};
+
+static int list_test_check(const uint8_t *out, void *priv)
+{
+	struct list_test_state *st = priv;
+
+	memcpy(st->cand[st->num++], out, LIST_TEST_BITS);
+	return !memcmp(out, st->sent, LIST_TEST_BITS);
+}
+
+/* The list decoder must only hand out distinct decodings and find the
+ * sent block often where the Viterbi decoder does not */
+static int list_test(void)
+{
+	uint8_t type2[LIST_TEST_BITS + 4] = { 0 }, mother[(LIST_TEST_BITS + 4) * 4];
+	uint8_t type3[120], out[LIST_TEST_BITS + 4], viterbi[LIST_TEST_BITS + 4];
+	int8_t in[(LIST_TEST_BITS + 8) * 4];
+	uint16_t mother_pos[120];
+	struct list_test_state st;
+	unsigned int plain = 0, list = 0, i, j;
+	int n, rank, plain_ok;
+	size_t mem_size;
+	void *mem;
+
+	mem_size = viterbi_k5_list_mem_size(LIST_TEST_BITS, LIST_TEST_PATHS, 0);
+	mem = malloc(mem_size);
+	if (!mem)
+		return -1;
+
+	tetra_rcpc_depunct_positions(TETRA_RCPC_PUNCT_2_3, 120, mother_pos);
+
+	srand(3);
+	for (n = 0; n < 500; n++) {
+		struct conv_enc_state ces;
+
+		for (i = 0; i < LIST_TEST_BITS; i++)
+			type2[i] = rand() & 1;
+		conv_enc_init(&ces);
+		conv_enc_input(&ces, type2, LIST_TEST_BITS + 4, mother);
+		get_punctured_rate(TETRA_RCPC_PUNCT_2_3, mother, 120, type3);
+
+		/* soft bits of a weak signal, one in six of them wrong */
+		memset(in, 0, sizeof(in));
+		for (i = 0; i < 120; i++) {
+			int v = (type3[i] ? -40 : 40) + rand() % 121 - 60;
+
+			in[mother_pos[i]] = v;
+		}
+
+		conv_cch_decode(in, viterbi, LIST_TEST_BITS + 4);
+		plain_ok = !memcmp(viterbi, type2, LIST_TEST_BITS);
+		plain += plain_ok;
+
+		st.sent = type2;
+		st.num = 0;
+		memcpy(out, viterbi, sizeof(out));
+		rank = conv_cch_decode_list(in, out, LIST_TEST_BITS, LIST_TEST_PATHS, 0,
+					    mem, mem_size, list_test_check, &st);
+		if (rank < 0 || st.num > LIST_TEST_PATHS) {
+			printf("List decode of block %d failed after %u paths\n", n, st.num);
+			goto err;
+		}
+		if (plain_ok || rank > 0)
+			list++;
+
+		for (i = 0; i < st.num; i++) {
+			for (j = 0; j < i; j++) {
+				if (!memcmp(st.cand[i], st.cand[j], LIST_TEST_BITS)) {
+					printf("List decode of block %d: paths %u and %u equal\n",
+					       n, j + 1, i + 1);
+					goto err;
+				}
+			}
+		}
+	}
+
+	free(mem);
+	printf("List decode: %u of 500 blocks, Viterbi: %u\n", list, plain);
+	if (list <= plain)
+		return -1;
+
+	return 0;
+
+err:
+	free(mem);
+	return -1;
+}
+
+/* the training sequences of EN 300 392-2 9.4.4.3, as in tetra_burst.c */
+static const struct {
+	enum tetra_train_seq type;
+	unsigned int len;
+	uint8_t bits[38];
+} test_seqs[] = {
+	{ TETRA_TRAIN_SYNC, 38, { 1,1, 0,0, 0,0, 0,1, 1,0, 0,1, 1,1, 0,0, 1,1, 1,0, 1,0, 0,1, 1,1,
+				  0,0, 0,0, 0,1, 1,0, 0,1, 1,1 } },
+	{ TETRA_TRAIN_NORM_1, 22, { 1,1, 0,1, 0,0, 0,0, 1,1, 1,0, 1,0, 0,1, 1,1, 0,1, 0,0 } },
+	{ TETRA_TRAIN_NORM_2, 22, { 0,1, 1,1, 1,0, 1,0, 0,1, 0,0, 0,0, 1,1, 0,1, 1,1, 1,0 } },
+	{ TETRA_TRAIN_NORM_3, 22, { 1,0, 1,1, 0,1, 1,1, 0,0, 0,0, 0,1, 1,0, 1,0, 1,1, 0,1 } },
+	{ TETRA_TRAIN_EXT, 30, { 1,0, 0,1, 1,1, 0,1, 0,0, 0,0, 1,1, 1,0, 1,0, 0,1, 1,1, 0,1, 0,0,
+				 0,0, 1,1 } },
+};
+
+/* the plain search the correlator replaced: compare byte by byte at every
+ * offset the whole sequence fits, keep the fewest errors, earliest first */
+static int ref_correlate(const uint8_t *in, unsigned int len, unsigned int s,
+			 unsigned int max_errors, struct tetra_train_seq_match *m)
+{
+	unsigned int offs, j, errors;
+	int found = 0;
+
+	for (offs = 0; offs + test_seqs[s].len <= len; offs++) {
+		errors = 0;
+		for (j = 0; j < test_seqs[s].len; j++)
+			errors += in[offs + j] != test_seqs[s].bits[j];
+		if (errors > max_errors || (found && errors >= m->errors))
+			continue;
+		m->offset = offs;
+		m->errors = errors;
+		found = 1;
+	}
+	return found;
+}
+
+/* the earliest exact match of the sequences in 'mask', checked in
+ * test_seqs[] order at every offset like the old tetra_find_train_seq() */
+static int ref_find(const uint8_t *in, unsigned int len, uint32_t mask, unsigned int *offset)
+{
+	unsigned int offs, s;
+
+	for (offs = 0; offs < len; offs++) {
+		for (s = 0; s < ARRAY_SIZE(test_seqs); s++) {
+			if (!(mask & (1 << test_seqs[s].type)) ||
+			    offs + test_seqs[s].len > len ||
+			    memcmp(in + offs, test_seqs[s].bits, test_seqs[s].len))
+				continue;
+			*offset = offs;
+			return test_seqs[s].type;
+		}
+	}
+	return -1;
+}
+
+static int train_seq_check(const uint8_t *in, unsigned int len)
+{
+	static const unsigned int max_errors[] = { 0, 2, 5 };
+	static const uint32_t masks[] = { 0x1f, 1 << TETRA_TRAIN_SYNC,
+					  (1 << TETRA_TRAIN_NORM_1) | (1 << TETRA_TRAIN_NORM_2) };
+	struct tetra_train_seq_match match[TETRA_TRAIN_EXT+1], ref = { 0, 0 };
+	unsigned int e, i, s, offs = 0, ref_offs = 0;
+	uint32_t found;
+	int type, ref_type;
+
+	for (e = 0; e < ARRAY_SIZE(max_errors); e++) {
+		found = tetra_correlate_train_seq(in, len, 0x1f, max_errors[e], match);
+		for (s = 0; s < ARRAY_SIZE(test_seqs); s++) {
+			enum tetra_train_seq t = test_seqs[s].type;
+
+			if (!ref_correlate(in, len, s, max_errors[e], &ref)) {
+				if (found & (1 << t))
+					goto fail;
+				continue;
+			}
+			if (!(found & (1 << t)) || match[t].offset != ref.offset ||
+			    match[t].errors != ref.errors)
+				goto fail;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(masks); i++) {
+		type = tetra_find_train_seq(in, len, masks[i], &offs);
+		ref_type = ref_find(in, len, masks[i], &ref_offs);
+		if (type != ref_type || (type >= 0 && offs != ref_offs)) {
+			printf("Training sequence search in %u bits: type %d at %u, expected %d at %u\n",
+			       len, type, offs, ref_type, ref_offs);
+			return -1;
+		}
+	}
+	return 0;
+
+fail:
+	printf("Training sequence %d correlation in %u bits with up to %u errors differs\n",
+	       test_seqs[s].type, len, max_errors[e]);
+	return -1;
+}
+
+/* The correlator must agree with the plain search for every sequence put
+ * at every offset, across the word boundaries, with bit errors in it */
+static int train_seq_test(void)
+{
+	static const unsigned int lens[] = { 22, 30, 38, 63, 64, 65, 100, 127, 128, 129, 192, 255 };
+	uint8_t in[256];
+	unsigned int l, len, s, offs, i, errors;
+
+	srand(5);
+	for (l = 0; l < ARRAY_SIZE(lens); l++) {
+		len = lens[l];
+		for (s = 0; s < ARRAY_SIZE(test_seqs); s++) {
+			for (offs = 0; offs + test_seqs[s].len <= len; offs++) {
+				for (i = 0; i < len; i++)
+					in[i] = rand() & 1;
+				memcpy(in + offs, test_seqs[s].bits, test_seqs[s].len);
+				for (errors = rand() % 4, i = 0; i < errors; i++)
+					in[offs + rand() % test_seqs[s].len] ^= 1;
+				if (train_seq_check(in, len) < 0)
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	int err, i;
@@ -321,13 +590,20 @@ int main(int argc, char **argv)
 		exit(1);
 
 	tetra_rm3014_init();
-#if 0
 	ret = tetra_rm3014_compute(0x1001);
 	printf("RM3014: 0x%08x\n", ret);
 
 	err = tetra_rm3014_decode(ret, &out);
 	printf("RM3014: 0x%x error: %d\n", out, err);
-#endif
+
+	if (rm3014_test() < 0)
+		exit(1);
+
+	if (list_test() < 0)
+		exit(1);
+
+	if (train_seq_test() < 0)
+		exit(1);
 
 	/* finally, build some test PDUs and encocde them */
 	testpdu_init();
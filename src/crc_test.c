@@ -16,12 +16,43 @@
  *
  */
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <osmocom/core/bits.h>
 
 #include "tetra_common.h"
 #include <lower_mac/crc_simple.h>
 
+/* table driven CRC against the bitwise one, whole and in fragments */
+static int check_table_crc(void)
+{
+	uint8_t ubits[600], pbits[75];
+	int i, j, len, split, failed = 0;
+
+	srand(1);
+	for (i = 0; i < 200; i++) {
+		uint16_t ref, crc;
+
+		len = rand() % sizeof(ubits);
+		split = len ? rand() % len : 0;
+		for (j = 0; j < (int) sizeof(pbits); j++)
+			pbits[j] = rand();
+		osmo_pbit2ubit(ubits, pbits, sizeof(ubits));
+
+		ref = crc16_itut_poly(0xffff, 0x1021, ubits, len);
+		if (crc16_ccitt_bits(ubits, len) != ref)
+			failed++;
+
+		crc = crc16_ccitt_update_bits(CRC16_CCITT_INIT, ubits, split);
+		crc = crc16_ccitt_update_bits(crc, ubits + split, len - split);
+		if (crc != ref)
+			failed++;
+	}
+
+	printf("Table CRC mismatches: %d\n", failed);
+	return failed;
+}
+
 int main(int argc, char **argv)
 {
 	uint8_t input1[] = { 0x01 };
@@ -71,5 +102,5 @@ int main(int argc, char **argv)
 	else
 		printf("Failed to decode.\n");
 
-	return 0;
+	return check_table_crc() ? 1 : 0;
 }
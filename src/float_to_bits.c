@@ -1,5 +1,5 @@
 /* Convert floating point symbols in the range +3/-3 to hard bits,
- * in the 1-bit-per-byte format */
+ * in the 1-bit-per-byte format, or to soft bits (int8_t per bit) */
 
 /* (C) 2011 by Harald Welte <laforge@gnumonks.org>
  * All Rights Reserved
@@ -24,74 +24,166 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <errno.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
-static int process_sym_fl(float fl)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Very simplistic scheme: the symbol is +3, +1, -1 or -3 as it is above 2,
+ * above 0, below -2 or else; these map to the dibits 01, 00, 11 and 10.
+ * So the first bit is 1 unless the symbol is positive, the second one is 1
+ * for the outer points.  No branches, the compiler turns the comparisons
+ * into flag or mask operations. */
+static inline void sym_fl2bits(float fl, uint8_t *ret)
+{
+	ret[0] = !(fl > 0);
+	ret[1] = (fl > 2) | (fl < -2);
+}
+
+/* soft bit per unit of symbol amplitude, +/-1 symbols map to +/-32 */
+#define SOFT_SCALE	32
+
+static int8_t clip_sbit(float v)
+{
+	if (v > 127)
+		return 127;
+	if (v < -127)
+		return -127;
+	return v;
+}
+
+/* Soft version of sym_fl2bits(): +127 = 0, -127 = 1.  The first bit
+ * follows the sign of the symbol, the second one is 1 for the outer
+ * (+/-3) constellation points, so its reliability is the distance of
+ * |fl| from the decision threshold at 2. */
+static void sym_fl2sbits(float fl, int8_t *ret)
+{
+	float mag = fl < 0 ? -fl : fl;
+
+	ret[0] = clip_sbit(fl * SOFT_SCALE);
+	ret[1] = clip_sbit((2 - mag) * SOFT_SCALE);
+}
+
+/* slice 'n' symbols into 2*n hard bits */
+static void slice_hard(const float *fl, uint8_t *bits, unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	const __m128 zero = _mm_setzero_ps(), two = _mm_set1_ps(2), mtwo = _mm_set1_ps(-2);
+	const __m128i one = _mm_set1_epi32(1);
+
+	/* four symbols give four 0/-1 masks per bit, interleaved and
+	 * packed down to eight bytes */
+	for (; i + 8 <= n; i += 8) {
+		__m128i b[4], w0, w1;
+		unsigned int k;
+
+		for (k = 0; k < 2; k++) {
+			__m128 v = _mm_loadu_ps(fl + i + 4*k);
+			__m128i b0 = _mm_andnot_si128(_mm_castps_si128(_mm_cmpgt_ps(v, zero)), one);
+			__m128i b1 = _mm_and_si128(_mm_castps_si128(_mm_or_ps(_mm_cmpgt_ps(v, two),
+									  _mm_cmplt_ps(v, mtwo))), one);
+
+			b[2*k] = _mm_unpacklo_epi32(b0, b1);
+			b[2*k+1] = _mm_unpackhi_epi32(b0, b1);
+		}
+		w0 = _mm_packs_epi32(b[0], b[1]);
+		w1 = _mm_packs_epi32(b[2], b[3]);
+		_mm_storeu_si128((__m128i *) (bits + 2*i), _mm_packus_epi16(w0, w1));
+	}
+#endif
+	for (; i < n; i++)
+		sym_fl2bits(fl[i], bits + 2*i);
+}
+
+/* slice 'n' symbols into 2*n soft bits */
+static void slice_soft(const float *fl, int8_t *sbits, unsigned int n)
 {
-	int ret;
-
-	/* very simplistic scheme */
-	if (fl > 2)
-		ret = 3;
-	else if (fl > 0)
-		ret = 1;
-	else if (fl < -2)
-		ret = -3;
-	else
-		ret = -1;
-
-	return ret;
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(SOFT_SCALE), two = _mm_set1_ps(2);
+	const __m128 lo = _mm_set1_ps(-127), hi = _mm_set1_ps(127);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	/* the same clipping and truncation towards zero as clip_sbit() */
+	for (; i + 8 <= n; i += 8) {
+		__m128i s[4], w0, w1;
+		unsigned int k;
+
+		for (k = 0; k < 2; k++) {
+			__m128 v = _mm_loadu_ps(fl + i + 4*k);
+			__m128 s0 = _mm_mul_ps(v, scale);
+			__m128 s1 = _mm_mul_ps(_mm_sub_ps(two, _mm_and_ps(v, abs_mask)), scale);
+			__m128i i0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(s0, lo), hi));
+			__m128i i1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(s1, lo), hi));
+
+			s[2*k] = _mm_unpacklo_epi32(i0, i1);
+			s[2*k+1] = _mm_unpackhi_epi32(i0, i1);
+		}
+		w0 = _mm_packs_epi32(s[0], s[1]);
+		w1 = _mm_packs_epi32(s[2], s[3]);
+		_mm_storeu_si128((__m128i *) (sbits + 2*i), _mm_packs_epi16(w0, w1));
+	}
+#endif
+	for (; i < n; i++)
+		sym_fl2sbits(fl[i], sbits + 2*i);
 }
 
-static void sym_int2bits(int sym, uint8_t *ret)
+static int write_all(int fd, const uint8_t *buf, size_t len)
 {
-	switch (sym) {
-	case -3:
-		ret[0] = 1;
-		ret[1] = 1;
-		break;
-	case 1:
-		ret[0] = 0;
-		ret[1] = 0;
-		break;
-	//case -1:
-	case 3:
-		ret[0] = 0;
-		ret[1] = 1;
-		break;
-	//case 3:
-	case -1:
-		ret[0] = 1;
-		ret[1] = 0;
-		break;
+	while (len) {
+		ssize_t rc = write(fd, buf, len);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += rc;
+		len -= rc;
 	}
+
+	return 0;
 }
 
-// size of IO buffers (number of elements)
-#define BUF_SIZE 1024
+/* size of IO buffers (number of symbols); large, so that a pipe is
+ * drained with few system calls */
+#define BUF_SIZE (64*1024)
+
+static float fl[BUF_SIZE];
+static uint8_t bits[2*BUF_SIZE];
 
 int main(int argc, char **argv)
 {
 	int fd, fd_out, opt;
+	size_t have = 0;
 
 	int opt_verbose = 0;
+	int opt_soft = 0;
 
-	while ((opt = getopt(argc, argv, "v")) != -1) {
+	while ((opt = getopt(argc, argv, "vs")) != -1) {
 		switch (opt) {
 		case 'v':
 			opt_verbose = 1;
 			break;
+		case 's':
+			opt_soft = 1;
+			break;
 		default:
 			exit(2);
 		}
 	}
 
 	if (argc <= optind+1) {
-		fprintf(stderr, "Usage: %s [-v] <infile> <outfile>\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-v] [-s] <infile> <outfile>\n", argv[0]);
 		exit(2);
 	}
 
@@ -106,33 +198,43 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 	while (1) {
-		int rc;
-		float fl[BUF_SIZE];
-		uint8_t bits[2*BUF_SIZE];
-		rc = read(fd, fl, sizeof(*fl) * BUF_SIZE);
+		uint8_t *buf = (uint8_t *) fl;
+		ssize_t rc;
+		unsigned int n;
+
+		rc = read(fd, buf + have, sizeof(fl) - have);
 		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
 			perror("read");
 			exit(1);
 		} else if (rc == 0) {
 			break;
 		}
-		rc /= sizeof(*fl);
-		int i;
-		for (i = 0; i < rc; ++i) {
-			int sym = process_sym_fl(fl[i]);
-			sym_int2bits(sym, bits + i*2);
-			//printf("%2d %1u %1u  %f\n", rc, bits[0], bits[1], fl);
-			if (opt_verbose) {
+
+		/* a partial float stays for the next read */
+		have += rc;
+		n = have / sizeof(*fl);
+
+		if (opt_soft)
+			slice_soft(fl, (int8_t *) bits, n);
+		else
+			slice_hard(fl, bits, n);
+
+		if (opt_verbose && !opt_soft) {
+			unsigned int i;
+
+			for (i = 0; i < n; i++)
 				printf("%1u%1u", bits[2*i + 0], bits[2*i + 1]);
-			}
 		}
 
-		rc = write(fd_out, bits, rc * 2);
-		if (rc < 0) {
+		if (write_all(fd_out, bits, n * 2) < 0) {
 			perror("write");
 			exit(1);
-		} else if (rc == 0)
-			break;
+		}
+
+		have -= n * sizeof(*fl);
+		memmove(buf, buf + n * sizeof(*fl), have);
 	}
 	exit(0);
 }
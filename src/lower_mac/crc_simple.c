@@ -21,6 +21,7 @@
 
 #include <lower_mac/crc_simple.h>
 #include <stdio.h>
+#include <pthread.h>
 
 /**
  * X.25 rec 2.2.7.4 Frame Check Sequence. This should be
@@ -38,46 +39,105 @@ uint16_t get_nth_bit(const uint8_t *input, int _bit)
 	return val;
 }
 
+/* crc16_tab[k][b] is the register contribution of byte b followed by k
+ * zero bytes, so eight input bytes fold into the CRC with eight lookups */
+static uint16_t crc16_tab[8][256];
+static pthread_once_t crc16_tab_once = PTHREAD_ONCE_INIT;
+
+static void crc16_tab_init(void)
+{
+	int b, i, k;
+
+	for (b = 0; b < 256; b++) {
+		uint16_t crc = b << 8;
+
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ GEN_POLY : crc << 1;
+		crc16_tab[0][b] = crc;
+	}
+
+	for (k = 1; k < 8; k++) {
+		for (b = 0; b < 256; b++) {
+			uint16_t prev = crc16_tab[k-1][b];
+
+			crc16_tab[k][b] = (prev << 8) ^ crc16_tab[0][prev >> 8];
+		}
+	}
+}
+
 /**
  * This is mostly from http://en.wikipedia.org/wiki/Computation_of_CRC
  * Code fragment 2. Due some stupidity it took longer to implement than
  * it should have taken.
  */
+static uint16_t crc16_update_bit(uint16_t crc, uint16_t bit)
+{
+	crc ^= bit << 15;
+	if ((crc & 0x8000)) {
+		crc <<= 1;
+		crc ^= GEN_POLY;
+	} else {
+		crc <<= 1;
+	}
+
+	return crc;
+}
+
+/* the whole bytes of the input are processed slicing-by-8, only the bits
+ * of a trailing partial byte go through the bitwise update */
 uint16_t crc16_itut_bytes(uint16_t crc, const uint8_t *input, int number_bits)
 {
+	int nbytes = number_bits / 8;
 	int i;
 
-	for (i = 0; i < number_bits; ++i) {
-		uint16_t bit = get_nth_bit(input, i);
+	pthread_once(&crc16_tab_once, crc16_tab_init);
 
-		crc ^= bit << 15;
-		if ((crc & 0x8000)) {
-			crc <<= 1;
-			crc ^= GEN_POLY;
-		} else {
-			crc <<= 1;
-		}
+	for (; nbytes >= 8; nbytes -= 8, input += 8) {
+		crc = crc16_tab[7][input[0] ^ (crc >> 8)] ^
+		      crc16_tab[6][input[1] ^ (crc & 0xff)] ^
+		      crc16_tab[5][input[2]] ^ crc16_tab[4][input[3]] ^
+		      crc16_tab[3][input[4]] ^ crc16_tab[2][input[5]] ^
+		      crc16_tab[1][input[6]] ^ crc16_tab[0][input[7]];
 	}
 
+	for (; nbytes > 0; nbytes--, input++)
+		crc = (crc << 8) ^ crc16_tab[0][(crc >> 8) ^ *input];
+
+	for (i = 0; i < number_bits % 8; i++)
+		crc = crc16_update_bit(crc, get_nth_bit(input, i));
+
 	return crc;
 }
 
-uint16_t crc16_itut_bits(uint16_t crc, const uint8_t *input, int number_bits)
+static inline uint8_t ubits_to_byte(const uint8_t *in)
 {
-	int i;
+	return (in[0] & 1) << 7 | (in[1] & 1) << 6 | (in[2] & 1) << 5 |
+	       (in[3] & 1) << 4 | (in[4] & 1) << 3 | (in[5] & 1) << 2 |
+	       (in[6] & 1) << 1 | (in[7] & 1);
+}
 
-	for (i = 0; i < number_bits; ++i) {
-		uint16_t bit = input[i] & 0x1;
+/* ubits are packed a chunk at a time and then run through the table */
+#define CRC16_PACK_BYTES	64
 
-		crc ^= bit << 15;
-		if ((crc & 0x8000)) {
-			crc <<= 1;
-			crc ^= GEN_POLY;
-		} else {
-			crc <<= 1;
-		}
+uint16_t crc16_itut_bits(uint16_t crc, const uint8_t *input, int number_bits)
+{
+	uint8_t pbits[CRC16_PACK_BYTES];
+
+	while (number_bits >= 8) {
+		int nbytes = number_bits / 8;
+		int i;
+
+		if (nbytes > CRC16_PACK_BYTES)
+			nbytes = CRC16_PACK_BYTES;
+		for (i = 0; i < nbytes; i++, input += 8)
+			pbits[i] = ubits_to_byte(input);
+		crc = crc16_itut_bytes(crc, pbits, nbytes * 8);
+		number_bits -= nbytes * 8;
 	}
 
+	for (; number_bits > 0; number_bits--, input++)
+		crc = crc16_update_bit(crc, *input & 0x1);
+
 	return crc;
 }
 
@@ -100,7 +160,12 @@ uint16_t crc16_itut_poly(uint16_t crc, uint32_t poly, const uint8_t *input, int
 	return crc;
 }
 
-uint16_t crc16_ccitt_bits(uint8_t *bits, unsigned int len)
+uint16_t crc16_ccitt_bits(const uint8_t *bits, unsigned int len)
 {
 	return crc16_itut_bits(0xffff, bits, len);
 }
+
+uint16_t crc16_ccitt_update_bits(uint16_t crc, const uint8_t *bits, unsigned int len)
+{
+	return crc16_itut_bits(crc, bits, len);
+}
@@ -42,7 +42,21 @@ uint16_t crc16_itut_bytes(uint16_t crc,
 uint16_t crc16_itut_bits(uint16_t crc,
 			 const uint8_t *input, const int number_bits);
 
+/**
+ * Bit by bit over ubits with an arbitrary generator polynomial.
+ */
+uint16_t crc16_itut_poly(uint16_t crc, uint32_t poly,
+			 const uint8_t *input, int number_bits);
+
+uint16_t crc16_ccitt_bits(const uint8_t *bits, unsigned int len);
+
+/**
+ * Incremental CRC16-CCITT for data that arrives in fragments: start with
+ * CRC16_CCITT_INIT and feed the fragments in order.  Once the received
+ * (inverted) CRC has been fed as well, the result is TETRA_CRC_OK.
+ */
+#define CRC16_CCITT_INIT	0xffff
 
-uint16_t crc16_ccitt_bits(uint8_t *bits, unsigned int len);
+uint16_t crc16_ccitt_update_bits(uint16_t crc, const uint8_t *bits, unsigned int len);
 
 #endif
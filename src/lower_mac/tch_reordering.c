@@ -30,10 +30,11 @@
 static const uint8_t class0_positions[NUM_ACELP_CLASS0_BITS] = {
 	35, 36, 37,
 	38, 39, 40,
-	41, 42, 33,
+	41, 42, 43,
 	47, 48,
 	56,
-	61, 62, 63,
+	61,
+	62, 63, 64,
 	65, 66, 67,
 	68, 69, 70,
 	74, 75,
@@ -30,6 +30,9 @@ int get_punctured_rate(enum tetra_rcpc_puncturer pu, uint8_t *in, int len, uint8
 /* De-Puncture the 'len' type-3 bits (in) and write mother code to out */
 int tetra_rcpc_depunct(enum tetra_rcpc_puncturer pu, const uint8_t *in, int len, uint8_t *out);
 
+/* mother code position (0-based) of each of the 'len' type-3 bits */
+int tetra_rcpc_depunct_positions(enum tetra_rcpc_puncturer pu, int len, uint16_t *mother_pos);
+
 /* Self-test the puncturing/de-puncturing */
 int tetra_punct_test(void);
 
@@ -58,25 +58,35 @@ void block_deinterleave(uint32_t K, uint32_t a, const uint8_t *in, uint8_t *out)
 	}
 }
 
-/* EN 300 395-2 Section 5.5.3 Matrix interleaving (voice */
+/* type-4 position (0-based) of each of the K deinterleaved type-3 bits */
+void block_deinterleave_positions(uint32_t K, uint32_t a, uint16_t *type4_pos)
+{
+	uint32_t i;
+
+	for (i = 1; i <= K; i++)
+		type4_pos[i-1] = block_interl_func(K, a, i) - 1;
+}
+
+/* EN 300 395-2 Section 5.5.3 Matrix interleaving (voice): the bits are
+ * written into a matrix line by line and read out column by column */
 void matrix_interleave(uint32_t lines, uint32_t columns,
 			const uint8_t *in, uint8_t *out)
 {
-	int i, j;
+	uint32_t i, j;
 
 	for (i = 0; i < columns; i++) {
 		for (j = 0; j < lines; j++)
-			out[i*lines + columns] = in[j*columns + lines];
+			out[i*lines + j] = in[j*columns + i];
 	}
 }
 
 void matrix_deinterleave(uint32_t lines, uint32_t columns,
 			 const uint8_t *in, uint8_t *out)
 {
-	int i, j;
+	uint32_t i, j;
 
 	for (i = 0; i < columns; i++) {
 		for (j = 0; j < lines; j++)
-			out[j*columns + lines] = in[i*lines + columns];
+			out[j*columns + i] = in[i*lines + j];
 	}
 }
@@ -9,6 +9,9 @@
 void block_interleave(uint32_t K, uint32_t a, const uint8_t *in, uint8_t *out);
 void block_deinterleave(uint32_t K, uint32_t a, const uint8_t *in, uint8_t *out);
 
+/* type-4 position (0-based) of each of the K deinterleaved type-3 bits */
+void block_deinterleave_positions(uint32_t K, uint32_t a, uint16_t *type4_pos);
+
 void matrix_interleave(uint32_t lines, uint32_t columns,
 			const uint8_t *in, uint8_t *out);
 void matrix_deinterleave(uint32_t lines, uint32_t columns,
@@ -22,7 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <linux/limits.h>
+#include <pthread.h>
 
 #include <osmocom/core/utils.h>
 #include <osmocom/core/msgb.h>
@@ -36,9 +36,12 @@
 #include <lower_mac/tetra_scramb.h>
 #include <lower_mac/tetra_interleave.h>
 #include <lower_mac/tetra_conv_enc.h>
+#include <lower_mac/tetra_rm3014.h>
 #include <tetra_prim.h>
 #include "tetra_upper_mac.h"
-#include <lower_mac/viterbi.h>
+#include "tetra_dump.h"
+#include <lower_mac/viterbi_k5.h>
+#include <lower_mac/viterbi_cch.h>
 
 struct tetra_blk_param {
 	const char *name;
@@ -115,17 +118,6 @@ static const struct tetra_blk_param tetra_blk_param[] = {
 	},
 };
 
-struct tetra_cell_data {
-	uint16_t mcc;
-	uint16_t mnc;
-	uint8_t colour_code;
-	struct tetra_tdma_time time;
-
-	uint32_t scramb_init;
-};
-
-static struct tetra_cell_data _tcd, *tcd = &_tcd;
-
 int is_bsch(struct tetra_tdma_time *tm)
 {
 	if (tm->fn == 18 && tm->tn == 4 - ((tm->mn+1)%4))
@@ -140,30 +132,274 @@ int is_bnch(struct tetra_tdma_time *tm)
 	return 0;
 }
 
-struct tetra_tmvsap_prim *tmvsap_prim_alloc(uint16_t prim, uint8_t op)
+#define sbit_dump(sbits, n)	osmo_hexdump((const unsigned char *)(sbits), n)
+
+/* De-scramble the type-5 soft bits of a block into type-4 soft bits */
+static void lower_mac_descramble(struct tetra_cell_data *tcd, const struct tetra_blk_param *tbp,
+				 uint32_t scramb_init, const int8_t *type5, int8_t *type4)
 {
-	struct tetra_tmvsap_prim *ttp;
+	struct tetra_scramb_seq *cache;
 
-	ttp = talloc_zero(NULL, struct tetra_tmvsap_prim);
-	ttp->oph.msg = msgb_alloc(412, "tmvsap_prim");
-	ttp->oph.sap = TETRA_SAP_TMV;
-	ttp->oph.primitive = prim;
-	ttp->oph.operation = op;
+	if (scramb_init == SCRAMB_INIT)
+		cache = &tcd->sb1_scramb_seq;
+	else
+		cache = &tcd->scramb_seq;
 
-	return ttp;
+	tetra_scramb_seq_sbits(tetra_scramb_seq_get(cache, scramb_init), type5, type4,
+			       tbp->type345_bits);
 }
 
-/* incoming DP-SAP UNITDATA.ind  from PHY into lower MAC */
-void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned int len, void *priv)
+/* mother code symbols of the longest block, SCH/F: (288 + 4 tail bits) * 4 */
+#define LOWER_MAC_MOTHER_MAX	((288 + 4) * 4)
+
+/* Per block type, the type-4 position feeding each mother code symbol, so
+ * that de-interleaving and de-puncturing become one gather.  Punctured
+ * symbols and the flush point at position type345_bits, which the decoder
+ * sets to 0 (erasure). */
+static uint16_t lower_mac_plan[ARRAY_SIZE(tetra_blk_param)][LOWER_MAC_MOTHER_MAX];
+static pthread_once_t lower_mac_plan_once = PTHREAD_ONCE_INIT;
+
+static void lower_mac_build_plans(void)
 {
-	/* various intermediary buffers */
-	uint8_t type4[512];
-	uint8_t type3dp[512*4];
-	uint8_t type3[512];
+	uint16_t type4_pos[512], mother_pos[512];
+	unsigned int t, i;
+
+	for (t = 0; t < ARRAY_SIZE(tetra_blk_param); t++) {
+		const struct tetra_blk_param *tbp = &tetra_blk_param[t];
+		uint16_t *plan = lower_mac_plan[t];
+
+		if (!tbp->interleave_a)
+			continue;
+
+		for (i = 0; i < (tbp->type2_bits + 4) * 4; i++)
+			plan[i] = tbp->type345_bits;
+
+		/* type-3 bit i is type-4 bit type4_pos[i] and goes to mother
+		 * code symbol mother_pos[i] */
+		block_deinterleave_positions(tbp->type345_bits, tbp->interleave_a, type4_pos);
+		tetra_rcpc_depunct_positions(TETRA_RCPC_PUNCT_2_3, tbp->type345_bits, mother_pos);
+		for (i = 0; i < tbp->type345_bits; i++)
+			plan[mother_pos[i]] = type4_pos[i];
+	}
+}
+
+/* A block on its way through the lower MAC.  Each stage (de-scrambling,
+ * de-interleaving and decoding, CRC) runs across all blocks of a batch
+ * before the next one, the results go up to the upper MAC in order. */
+struct lower_mac_blk {
+	const struct tetra_sap_blk *sap;
+	const struct tetra_blk_param *tbp;
+	uint32_t scramb_init;
+	uint16_t crc;
+	unsigned int list_rank;	/* > 0: the list decoding of this rank passed the CRC */
+	int8_t type4[512+1];
+	int8_t type3dp[LOWER_MAC_MOTHER_MAX];
 	uint8_t type2[512];
+};
+
+/* number of blocks run through the stages together */
+#define LOWER_MAC_BATCH	16
+
+/* SB1 resp. DSB1 use the pre-defined scrambling and tell the one of the cell */
+static int lower_mac_is_sync(const struct tetra_sap_blk *sap)
+{
+	if (sap->dp)
+		return sap->type == DPSAP_T_DSB1;
+	return sap->type == TPSAP_T_SB1;
+}
+
+/* scrambling code of the cell announced in a SYNC PDU */
+static uint32_t lower_mac_sync_scramb(const uint8_t *type2)
+{
+	return tetra_scramb_get_init(bits_to_uint(type2+31, 10), bits_to_uint(type2+41, 14),
+				     bits_to_uint(type2+4, 6));
+}
+
+/* De-interleave and de-puncture the type-4 soft bits of an interleaved
+ * block into the mother code symbols */
+static void lower_mac_gather(struct lower_mac_blk *blk)
+{
+	const struct tetra_blk_param *tbp = blk->tbp;
+	const uint16_t *plan = lower_mac_plan[tbp - tetra_blk_param];
+	unsigned int i, n = (tbp->type2_bits + 4) * 4;
+
+	blk->type4[tbp->type345_bits] = 0;
+	for (i = 0; i < n; i++)
+		blk->type3dp[i] = blk->type4[plan[i]];
+}
+
+/* Run the blocks of the batch that are (not) SYNC blocks through
+ * de-scrambling, de-interleaving, Viterbi decoding and the CRC check */
+static void lower_mac_stages(struct tetra_cell_data *tcd, struct lower_mac_blk *blks,
+			     unsigned int count, int sync)
+{
+	int8_t *in[LOWER_MAC_BATCH];
+	uint8_t *out[LOWER_MAC_BATCH];
+	unsigned int i, j, n;
+
+	pthread_once(&lower_mac_plan_once, lower_mac_build_plans);
+
+	for (i = 0; i < count; i++) {
+		struct lower_mac_blk *blk = &blks[i];
+
+		if (lower_mac_is_sync(blk->sap) != sync)
+			continue;
+		lower_mac_descramble(tcd, blk->tbp, blk->scramb_init, blk->sap->bits, blk->type4);
+		if (blk->tbp->interleave_a)
+			lower_mac_gather(blk);
+	}
+
+	/* blocks of the same type share the passes of the Viterbi decoder */
+	for (i = 0; i < count; i++) {
+		const struct tetra_blk_param *tbp = blks[i].tbp;
 
-	const struct tetra_blk_param *tbp = &tetra_blk_param[type];
-	struct tetra_mac_state *tms = priv;
+		if (lower_mac_is_sync(blks[i].sap) != sync || !tbp->interleave_a)
+			continue;
+		/* only start at the first block of each type */
+		for (j = 0; j < i; j++) {
+			if (blks[j].tbp == tbp && lower_mac_is_sync(blks[j].sap) == sync)
+				break;
+		}
+		if (j < i)
+			continue;
+
+		for (n = 0; j < count; j++) {
+			if (blks[j].tbp != tbp || lower_mac_is_sync(blks[j].sap) != sync)
+				continue;
+			in[n] = blks[j].type3dp;
+			out[n] = blks[j].type2;
+			n++;
+		}
+		conv_cch_decode_batch(in, out, tbp->type2_bits, n);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct lower_mac_blk *blk = &blks[i];
+
+		if (lower_mac_is_sync(blk->sap) != sync || !blk->tbp->have_crc16)
+			continue;
+		blk->crc = crc16_ccitt_bits(blk->type2, blk->tbp->type1_bits+16);
+	}
+}
+
+/* channel of the list decoding settings of a block, -1 if it has none */
+static int lower_mac_list_chan(const struct tetra_sap_blk *sap)
+{
+	if (sap->dp) {
+		switch (sap->type) {
+		case DPSAP_T_DSB1:
+			return TETRA_LIST_SB1;
+		case DPSAP_T_DSB2:
+			return TETRA_LIST_SB2;
+		default:
+			return -1;
+		}
+	}
+
+	switch (sap->type) {
+	case TPSAP_T_SB1:
+		return TETRA_LIST_SB1;
+	case TPSAP_T_SB2:
+		return TETRA_LIST_SB2;
+	case TPSAP_T_NDB:
+		return TETRA_LIST_NDB;
+	case TPSAP_T_SCH_F:
+		return TETRA_LIST_SCH_F;
+	default:
+		return -1;
+	}
+}
+
+static int lower_mac_list_check(const uint8_t *type2, void *priv)
+{
+	const struct lower_mac_blk *blk = priv;
+
+	return crc16_ccitt_bits(type2, blk->tbp->type1_bits+16) == TETRA_CRC_OK;
+}
+
+/* Give a block that failed its CRC another chance: try the most likely
+ * decodings, as many as set up for its channel, and keep the first one
+ * that passes the CRC.  The trellis ends after the four tail bits, so
+ * decodings differing only in those are not tried. */
+static void lower_mac_list_decode(struct tetra_mac_state *tms, struct lower_mac_blk *blk)
+{
+	const struct tetra_blk_param *tbp = blk->tbp;
+	const struct tetra_list_dec *ld;
+	uint8_t type2[512];
+	size_t size;
+	int chan, rank;
+
+	if (!tbp->have_crc16 || blk->crc == TETRA_CRC_OK)
+		return;
+	chan = lower_mac_list_chan(blk->sap);
+	if (chan < 0 || tms->list_dec[chan].paths < 2)
+		return;
+	/* a traffic slot carries speech rather than a CRC protected block */
+	if (chan == TETRA_LIST_SCH_F && tms->cur_burst.is_traffic)
+		return;
+	ld = &tms->list_dec[chan];
+
+	/* the storage grows to the largest search set up, then stays */
+	size = viterbi_k5_list_mem_size(tbp->type1_bits+16, ld->paths, ld->budget);
+	if (size > tms->list_mem_size) {
+		talloc_free(tms->list_mem);
+		tms->list_mem = talloc_size(tms, size);
+		tms->list_mem_size = tms->list_mem ? size : 0;
+	}
+
+	memcpy(type2, blk->type2, tbp->type1_bits+16);
+	rank = conv_cch_decode_list(blk->type3dp, type2, tbp->type1_bits+16, ld->paths,
+				    ld->budget, tms->list_mem, tms->list_mem_size,
+				    lower_mac_list_check, blk);
+	if (rank <= 0)
+		return;
+
+	memcpy(blk->type2, type2, tbp->type1_bits+16);
+	blk->crc = TETRA_CRC_OK;
+	blk->list_rank = rank;
+}
+
+/* log the intermediate results of the decoding stages */
+static void lower_mac_dump(const struct lower_mac_blk *blk, const char *time_str)
+{
+	const struct tetra_blk_param *tbp = blk->tbp;
+
+	TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s %s type5: %s\n", tbp->name, time_str,
+		sbit_dump(blk->sap->bits, tbp->type345_bits));
+	TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s %s type4: %s\n", tbp->name, time_str,
+		sbit_dump(blk->type4, tbp->type345_bits));
+}
+
+/* Reed-Muller decode the AACH of a BBK into its corrected 30 type-2 bits;
+ * the block is good if no more errors were found than the code corrects */
+static int lower_mac_bbk_decode(const int8_t *type4, uint8_t *type2, const char *time_str)
+{
+	uint16_t info;
+	uint32_t word;
+	int errors, i;
+
+	errors = tetra_rm3014_decode_soft(type4, &info);
+	word = tetra_rm3014_compute(info);
+	for (i = 0; i < 30; i++)
+		type2[i] = (word >> (29 - i)) & 1;
+
+	if (errors > RM3014_MAX_ERRORS)
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "BBK %s RM3014: %d errors, uncorrectable\n",
+			time_str, errors);
+	else if (errors)
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "BBK %s RM3014: %d errors corrected\n",
+			time_str, errors);
+
+	return errors <= RM3014_MAX_ERRORS;
+}
+
+/* hand a decoded DP-SAP block to the upper MAC */
+static void lower_mac_dp_deliver(struct tetra_mac_state *tms, struct lower_mac_blk *blk)
+{
+	enum dp_sap_data_type type = blk->sap->type;
+	const struct tetra_blk_param *tbp = blk->tbp;
+	uint8_t *type2 = blk->type2;
+	struct tetra_cell_data *tcd = &tms->cell;
 	const char *time_str;
 
 	/* DMV-SAP.UNITDATA.ind primitive which we will send to the upper MAC */
@@ -172,66 +408,44 @@ void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned
 
 	struct msgb *msg;
 
-	ttp = tmvsap_prim_alloc(PRIM_TMV_UNITDATA, PRIM_OP_INDICATION);
+	ttp = tetra_prim_alloc(tms->prim_pool, PRIM_TMV_UNITDATA, PRIM_OP_INDICATION);
 	tup = &ttp->u.unitdata;
 	msg = ttp->oph.msg;
 
 	/* update the cell time */
-	memcpy(&tcd->time, &t_phy_state.time, sizeof(tcd->time));
+	memcpy(&tcd->time, &tms->phy_state.time, sizeof(tcd->time));
 	time_str = tetra_tdma_time_dump(&tcd->time);
 
 	if (type == DPSAP_T_DSB2 && is_bnch(&tcd->time)) {
 		tup->lchan = TETRA_LC_BNCH;
-		printf("BNCH FOLLOWS\n");
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "BNCH FOLLOWS\n");
 	}
 
-	DEBUGP("%s %s type5: %s\n", tbp->name, tetra_tdma_time_dump(&tcd->time),
-		osmo_ubit_dump(bits, tbp->type345_bits));
-
-	/* De-scramble, pay special attention to SB1 pre-defined scrambling */
-	memcpy(type4, bits, tbp->type345_bits);
-	if (type == DPSAP_T_DSB1) {
-		tetra_scramb_bits(SCRAMB_INIT, type4, tbp->type345_bits);
-		tup->colour_code = SCRAMB_INIT;
-	} else {
-		tetra_scramb_bits(tcd->scramb_init, type4, tbp->type345_bits);
-		tup->colour_code = tcd->scramb_init;
-	}
-
-	DEBUGP("%s %s type4: %s\n", tbp->name, time_str,
-		osmo_ubit_dump(type4, tbp->type345_bits));
-
+	lower_mac_dump(blk, time_str);
+	tup->colour_code = blk->scramb_init;
 
 	if (tbp->interleave_a) {
-		/* Run block deinterleaving: type-3 bits */
-		block_deinterleave(tbp->type345_bits, tbp->interleave_a, type4, type3);
-		DEBUGP("%s %s type3: %s\n", tbp->name, time_str,
-			osmo_ubit_dump(type3, tbp->type345_bits));
-		/* De-puncture */
-		memset(type3dp, 0xff, sizeof(type3dp));
-		tetra_rcpc_depunct(TETRA_RCPC_PUNCT_2_3, type3, tbp->type345_bits, type3dp);
-		DEBUGP("%s %s type3dp: %s\n", tbp->name, time_str,
-			osmo_ubit_dump(type3dp, tbp->type2_bits*4));
-		viterbi_dec_sb1_wrapper(type3dp, type2, tbp->type2_bits);
-		DEBUGP("%s %s type2: %s\n", tbp->name, time_str,
+		TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s type3dp: %s\n", tbp->name,
+			sbit_dump(blk->type3dp, (tbp->type2_bits + 4) * 4));
+		TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s %s type2: %s\n", tbp->name, time_str,
 			osmo_ubit_dump(type2, tbp->type2_bits));
 	}
 
 	if (tbp->have_crc16) {
-		uint16_t crc = crc16_ccitt_bits(type2, tbp->type1_bits+16);
-		printf("CRC COMP: 0x%04x ", crc);
-		if (crc == TETRA_CRC_OK) {
-			printf("OK\n");
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "CRC COMP: 0x%04x ", blk->crc);
+		if (blk->crc == TETRA_CRC_OK) {
+			if (blk->list_rank)
+				TLOGP(TLOG_LMAC, TLOGL_INFO, "OK (list path %u)\n", blk->list_rank);
+			else
+				TLOGP(TLOG_LMAC, TLOGL_INFO, "OK\n");
 			tup->crc_ok = 1;
-			printf("%s %s type1: %s\n", tbp->name, time_str,
+			TLOGP(TLOG_LMAC, TLOGL_INFO, "%s %s type1: %s\n", tbp->name, time_str,
 				osmo_ubit_dump(type2, tbp->type1_bits));
 		} else
-			printf("WRONG\n");
+			TLOGP(TLOG_LMAC, TLOGL_INFO, "WRONG\n");
 	} else if (type == TPSAP_T_BBK) {
-		/* FIXME: RM3014-decode */
-		tup->crc_ok = 1;
-		memcpy(type2, type4, tbp->type2_bits);
-		DEBUGP("%s %s type1: %s\n", tbp->name, time_str,
+		tup->crc_ok = lower_mac_bbk_decode(blk->type4, type2, time_str);
+		TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s %s type1: %s\n", tbp->name, time_str,
 			osmo_ubit_dump(type2, tbp->type1_bits));
 	}
 
@@ -240,7 +454,7 @@ void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned
 
 	switch (type) {
 	case DPSAP_T_DSB1:
-		printf("DMAC-SYNC SCH/S PDU TYPE %s(0x%02x) ", osmo_ubit_dump(type2+4, 2), bits_to_uint(type2+4, 2));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "DMAC-SYNC SCH/S PDU TYPE %s(0x%02x) ", osmo_ubit_dump(type2+4, 2), bits_to_uint(type2+4, 2));
 		/* obtain information from SYNC PDU */
 		if (tup->crc_ok) {
 			tcd->colour_code = bits_to_uint(type2+4, 6);
@@ -250,14 +464,16 @@ void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned
 			tcd->mcc = bits_to_uint(type2+31, 10);
 			tcd->mnc = bits_to_uint(type2+41, 14);
 			/* compute the scrambling code for the current cell */
-			tcd->scramb_init = tetra_scramb_get_init(tcd->mcc, tcd->mnc, tcd->colour_code);
+			tcd->scramb_init = lower_mac_sync_scramb(type2);
+			/* the DM channel the sender uses: odd or even slots */
+			tms->phy_state.dmo_slots = (tcd->time.tn & 1) ? 0x5 : 0xa;
 		}
 		/* update the PHY layer time */
-		memcpy(&t_phy_state.time, &tcd->time, sizeof(t_phy_state.time));
+		memcpy(&tms->phy_state.time, &tcd->time, sizeof(tms->phy_state.time));
 		tup->lchan = TETRA_LC_BSCH;
 		break;
 	case DPSAP_T_DSB2:
-		printf("DMAC-SYNC SCH/H TYPE %s(0x%02x) ", osmo_ubit_dump(type2+4, 2), bits_to_uint(type2+4, 2));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "DMAC-SYNC SCH/H TYPE %s(0x%02x) ", osmo_ubit_dump(type2+4, 2), bits_to_uint(type2+4, 2));
 
 	case TPSAP_T_NDB:
 		/* FIXME: do something */
@@ -280,17 +496,14 @@ void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned
 
 }
 
-/* incoming TP-SAP UNITDATA.ind  from PHY into lower MAC */
-void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned int len, void *priv)
+/* hand a decoded TP-SAP block to the upper MAC */
+static void lower_mac_tp_deliver(struct tetra_mac_state *tms, struct lower_mac_blk *blk)
 {
-	/* various intermediary buffers */
-	uint8_t type4[512];
-	uint8_t type3dp[512*4];
-	uint8_t type3[512];
-	uint8_t type2[512];
-
-	const struct tetra_blk_param *tbp = &tetra_blk_param[type];
-	struct tetra_mac_state *tms = priv;
+	enum tp_sap_data_type type = blk->sap->type;
+	const struct tetra_blk_param *tbp = blk->tbp;
+	const int8_t *type4 = blk->type4;
+	uint8_t *type2 = blk->type2;
+	struct tetra_cell_data *tcd = &tms->cell;
 	const char *time_str;
 
 	/* TMV-SAP.UNITDATA.ind primitive which we will send to the upper MAC */
@@ -299,107 +512,53 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned
 
 	struct msgb *msg;
 
-	ttp = tmvsap_prim_alloc(PRIM_TMV_UNITDATA, PRIM_OP_INDICATION);
+	ttp = tetra_prim_alloc(tms->prim_pool, PRIM_TMV_UNITDATA, PRIM_OP_INDICATION);
 	tup = &ttp->u.unitdata;
 	msg = ttp->oph.msg;
 
 	/* update the cell time */
-	memcpy(&tcd->time, &t_phy_state.time, sizeof(tcd->time));
+	memcpy(&tcd->time, &tms->phy_state.time, sizeof(tcd->time));
 	time_str = tetra_tdma_time_dump(&tcd->time);
 
 	if (type == TPSAP_T_SB2 && is_bnch(&tcd->time)) {
 		tup->lchan = TETRA_LC_BNCH;
-		printf("BNCH FOLLOWS\n");
-	}
-
-	DEBUGP("%s %s type5: %s\n", tbp->name, tetra_tdma_time_dump(&tcd->time),
-		osmo_ubit_dump(bits, tbp->type345_bits));
-
-	/* De-scramble, pay special attention to SB1 pre-defined scrambling */
-	memcpy(type4, bits, tbp->type345_bits);
-	if (type == TPSAP_T_SB1) {
-		tetra_scramb_bits(SCRAMB_INIT, type4, tbp->type345_bits);
-		tup->scrambling_code = SCRAMB_INIT;
-	} else {
-		tetra_scramb_bits(tcd->scramb_init, type4, tbp->type345_bits);
-		tup->scrambling_code = tcd->scramb_init;
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "BNCH FOLLOWS\n");
 	}
 
-	DEBUGP("%s %s type4: %s\n", tbp->name, time_str,
-		osmo_ubit_dump(type4, tbp->type345_bits));
+	lower_mac_dump(blk, time_str);
+	tup->scrambling_code = blk->scramb_init;
 
 	/* If this is a traffic channel, dump. */
-	if ((type == TPSAP_T_SCH_F) && tms->cur_burst.is_traffic && tms->dumpdir) {
-		char fname[PATH_MAX];
-		int16_t block[690];
-		FILE *f;
-		int i;
-
-		/* Open target file */
-		snprintf(fname, sizeof(fname), "%s/traffic_%d_%d.out", tms->dumpdir,
-			tms->cur_burst.is_traffic, tms->tsn);
-		f = fopen(fname, "ab");
-
-		/* Generate a block */
-		memset(block, 0x00, sizeof(int16_t) * 690);
-		for (i = 0; i < 6; i++)
-			block[115*i] = 0x6b21 + i;
-
-		for (i = 0; i < 114; i++)
-			block[1+i] = type4[i] ? -127 : 127;
-
-		for (i = 0; i < 114; i++)
-			block[116+i] = type4[114+i] ? -127 : 127;
-
-		for (i = 0; i < 114; i++)
-			block[231+i] = type4[228+i] ? -127 : 127;
-
-		for (i = 0; i < 90; i++)
-			block[346+i] = type4[342+i] ? -127 : 127;
-
-		/* Write it */
-		fwrite(block, sizeof(int16_t), 690, f);
-
-		fclose(f);
-
-		/* Write used ssi */
-		snprintf(fname, sizeof(fname), "%s/traffic_%d_%d.txt", tms->dumpdir,
-			tms->cur_burst.is_traffic, tms->tsn);
-		f = fopen(fname, "a");
-		fprintf(f, "%d\n", tms->ssi);
-		fclose(f);
+	if (tms->dump) {
+		if (type == TPSAP_T_BBK)
+			tetra_dump_expire(tms->dump, &tcd->time);
+		else if (type == TPSAP_T_SCH_F && tms->cur_burst.is_traffic)
+			tetra_dump_traffic(tms->dump, tms->cur_burst.is_traffic, tms->tsn,
+					   tms->ssi, &tcd->time, type4);
 	}
 
 	if (tbp->interleave_a) {
-		/* Run block deinterleaving: type-3 bits */
-		block_deinterleave(tbp->type345_bits, tbp->interleave_a, type4, type3);
-		DEBUGP("%s %s type3: %s\n", tbp->name, time_str,
-			osmo_ubit_dump(type3, tbp->type345_bits));
-		/* De-puncture */
-		memset(type3dp, 0xff, sizeof(type3dp));
-		tetra_rcpc_depunct(TETRA_RCPC_PUNCT_2_3, type3, tbp->type345_bits, type3dp);
-		DEBUGP("%s %s type3dp: %s\n", tbp->name, time_str,
-			osmo_ubit_dump(type3dp, tbp->type2_bits*4));
-		viterbi_dec_sb1_wrapper(type3dp, type2, tbp->type2_bits);
-		DEBUGP("%s %s type2: %s\n", tbp->name, time_str,
+		TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s type3dp: %s\n", tbp->name,
+			sbit_dump(blk->type3dp, (tbp->type2_bits + 4) * 4));
+		TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s %s type2: %s\n", tbp->name, time_str,
 			osmo_ubit_dump(type2, tbp->type2_bits));
 	}
 
 	if (tbp->have_crc16) {
-		uint16_t crc = crc16_ccitt_bits(type2, tbp->type1_bits+16);
-		printf("CRC COMP: 0x%04x ", crc);
-		if (crc == TETRA_CRC_OK) {
-			printf("OK\n");
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "CRC COMP: 0x%04x ", blk->crc);
+		if (blk->crc == TETRA_CRC_OK) {
+			if (blk->list_rank)
+				TLOGP(TLOG_LMAC, TLOGL_INFO, "OK (list path %u)\n", blk->list_rank);
+			else
+				TLOGP(TLOG_LMAC, TLOGL_INFO, "OK\n");
 			tup->crc_ok = 1;
-			printf("%s %s type1: %s\n", tbp->name, time_str,
+			TLOGP(TLOG_LMAC, TLOGL_INFO, "%s %s type1: %s\n", tbp->name, time_str,
 				osmo_ubit_dump(type2, tbp->type1_bits));
 		} else
-			printf("WRONG\n");
+			TLOGP(TLOG_LMAC, TLOGL_INFO, "WRONG\n");
 	} else if (type == TPSAP_T_BBK) {
-		/* FIXME: RM3014-decode */
-		tup->crc_ok = 1;
-		memcpy(type2, type4, tbp->type2_bits);
-		DEBUGP("%s %s type1: %s\n", tbp->name, time_str,
+		tup->crc_ok = lower_mac_bbk_decode(type4, type2, time_str);
+		TLOGP(TLOG_LMAC, TLOGL_DEBUG, "%s %s type1: %s\n", tbp->name, time_str,
 			osmo_ubit_dump(type2, tbp->type1_bits));
 	}
 
@@ -408,12 +567,12 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned
 
 	switch (type) {
 	case TPSAP_T_SB1:
-		printf("TMB-SAP SYNC CC %s(0x%02x) ", osmo_ubit_dump(type2+4, 6), bits_to_uint(type2+4, 6));
-		printf("TN %s(%u) ", osmo_ubit_dump(type2+10, 2), bits_to_uint(type2+10, 2));
-		printf("FN %s(%2u) ", osmo_ubit_dump(type2+12, 5), bits_to_uint(type2+12, 5));
-		printf("MN %s(%2u) ", osmo_ubit_dump(type2+17, 6), bits_to_uint(type2+17, 6));
-		printf("MCC %s(%u) ", osmo_ubit_dump(type2+31, 10), bits_to_uint(type2+31, 10));
-		printf("MNC %s(%u)\n", osmo_ubit_dump(type2+41, 14), bits_to_uint(type2+41, 14));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "TMB-SAP SYNC CC %s(0x%02x) ", osmo_ubit_dump(type2+4, 6), bits_to_uint(type2+4, 6));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "TN %s(%u) ", osmo_ubit_dump(type2+10, 2), bits_to_uint(type2+10, 2));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "FN %s(%2u) ", osmo_ubit_dump(type2+12, 5), bits_to_uint(type2+12, 5));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "MN %s(%2u) ", osmo_ubit_dump(type2+17, 6), bits_to_uint(type2+17, 6));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "MCC %s(%u) ", osmo_ubit_dump(type2+31, 10), bits_to_uint(type2+31, 10));
+		TLOGP(TLOG_LMAC, TLOGL_INFO, "MNC %s(%u)\n", osmo_ubit_dump(type2+41, 14), bits_to_uint(type2+41, 14));
 		/* obtain information from SYNC PDU */
 		if (tup->crc_ok) {
 			tcd->colour_code = bits_to_uint(type2+4, 6);
@@ -423,10 +582,10 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned
 			tcd->mcc = bits_to_uint(type2+31, 10);
 			tcd->mnc = bits_to_uint(type2+41, 14);
 			/* compute the scrambling code for the current cell */
-			tcd->scramb_init = tetra_scramb_get_init(tcd->mcc, tcd->mnc, tcd->colour_code);
+			tcd->scramb_init = lower_mac_sync_scramb(type2);
 		}
 		/* update the PHY layer time */
-		memcpy(&t_phy_state.time, &tcd->time, sizeof(t_phy_state.time));
+		memcpy(&tms->phy_state.time, &tcd->time, sizeof(tms->phy_state.time));
 		tup->lchan = TETRA_LC_BSCH;
 		break;
 	case TPSAP_T_SB2:
@@ -449,4 +608,79 @@ void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned
 	upper_mac_prim_recv(&ttp->oph, tms);
 }
 
+/* Decode up to LOWER_MAC_BATCH blocks.  The SYNC blocks go first: once
+ * their CRC is known, the scrambling code in effect at every other block
+ * of the batch is too, and those can run through the stages together.
+ * The upper MAC then sees the blocks in order, exactly as if they had
+ * been handed in one at a time. */
+static void lower_mac_run(struct tetra_mac_state *tms, const struct tetra_sap_blk *saps,
+			  struct lower_mac_blk *blks, unsigned int count)
+{
+	struct tetra_cell_data *tcd = &tms->cell;
+	uint32_t scramb_init;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		blks[i].sap = &saps[i];
+		blks[i].tbp = &tetra_blk_param[saps[i].type];
+		blks[i].scramb_init = SCRAMB_INIT;
+		blks[i].list_rank = 0;
+	}
+	lower_mac_stages(tcd, blks, count, 1);
+
+	scramb_init = tcd->scramb_init;
+	for (i = 0; i < count; i++) {
+		if (!lower_mac_is_sync(&saps[i])) {
+			blks[i].scramb_init = scramb_init;
+			continue;
+		}
+		lower_mac_list_decode(tms, &blks[i]);
+		if (blks[i].crc == TETRA_CRC_OK)
+			scramb_init = lower_mac_sync_scramb(blks[i].type2);
+	}
+	lower_mac_stages(tcd, blks, count, 0);
+
+	for (i = 0; i < count; i++) {
+		if (saps[i].tn_adv)
+			tetra_tdma_time_add_tn(&tms->phy_state.time, saps[i].tn_adv);
+		/* only now the AACH before tells whether SCH/F is traffic */
+		if (!lower_mac_is_sync(&saps[i]))
+			lower_mac_list_decode(tms, &blks[i]);
+		if (saps[i].dp)
+			lower_mac_dp_deliver(tms, &blks[i]);
+		else
+			lower_mac_tp_deliver(tms, &blks[i]);
+	}
+}
+
+/* incoming DP-SAP UNITDATA.ind  from PHY into lower MAC */
+void dp_sap_udata_ind(enum dp_sap_data_type type, const int8_t *bits, unsigned int len, void *priv)
+{
+	struct tetra_sap_blk sap = { .dp = 1, .type = type, .bits = bits, .len = len };
+	struct lower_mac_blk blk;
+
+	lower_mac_run(priv, &sap, &blk, 1);
+}
+
+/* incoming TP-SAP UNITDATA.ind  from PHY into lower MAC */
+void tp_sap_udata_ind(enum tp_sap_data_type type, const int8_t *bits, unsigned int len, void *priv)
+{
+	struct tetra_sap_blk sap = { .type = type, .bits = bits, .len = len };
+	struct lower_mac_blk blk;
+
+	lower_mac_run(priv, &sap, &blk, 1);
+}
 
+/* incoming blocks of a run of bursts from PHY into lower MAC */
+void tp_sap_udata_ind_batch(const struct tetra_sap_blk *saps, unsigned int count, void *priv)
+{
+	struct lower_mac_blk blks[LOWER_MAC_BATCH];
+	unsigned int i, n;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i;
+		if (n > LOWER_MAC_BATCH)
+			n = LOWER_MAC_BATCH;
+		lower_mac_run(priv, saps + i, blks, n);
+	}
+}
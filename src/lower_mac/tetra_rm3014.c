@@ -20,6 +20,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include <lower_mac/tetra_rm3014.h>
 
@@ -44,6 +45,13 @@ static const uint8_t rm_30_14_gen[14][16] = {
 
 static uint32_t rm_30_14_rows[14];
 
+/* rm_syndrome_leader[s] is the lightest error pattern with syndrome s, all
+ * 65536 syndromes occur, the heaviest leaders have 7 bits set */
+static uint32_t rm_syndrome_leader[1 << 16];
+static pthread_once_t rm_tables_once = PTHREAD_ONCE_INIT;
+
+/* number of least reliable soft bits tried both ways */
+#define CHASE_BITS	4
 
 static uint32_t shift_bits_together(const uint8_t *bits, int len)
 {
@@ -56,41 +64,151 @@ static uint32_t shift_bits_together(const uint8_t *bits, int len)
 	return ret;
 }
 
-void tetra_rm3014_init(void)
+static uint32_t rm_compute(const uint16_t in)
 {
 	int i;
-	uint32_t val;
+	uint32_t val = 0;
 
 	for (i = 0; i < 14; i++) {
-		/* upper 14 bits identity matrix */
-		val = (1 << (16+13 - i));
-		/* lower 16 bits from rm_30_14_gen */
-		val |= shift_bits_together(rm_30_14_gen[i], 16);
-		rm_30_14_rows[i] = val;
-		printf("rm_30_14_rows[%u] = 0x%08x\n", i, val);
+		uint32_t bit = (in >> (14-1-i)) & 1;
+		if (bit)
+			val ^= rm_30_14_rows[i];
+		/* we can skip the 'else' as XOR with 0 has no effect */
 	}
+	return val;
 }
 
-uint32_t tetra_rm3014_compute(const uint16_t in)
+/* the parity bits received, XOR the ones of the received information */
+static uint16_t rm_syndrome(uint32_t word)
+{
+	return (word ^ rm_compute(word >> 16)) & 0xffff;
+}
+
+static void rm_tables_init(void)
 {
+	static uint16_t queue[1 << 16];
+	static uint8_t seen[1 << 16];
+	unsigned int head = 0, tail = 0;
 	int i;
-	uint32_t val = 0;
 
 	for (i = 0; i < 14; i++) {
-		uint32_t bit = (in >> (14-1-i)) & 1;
-		if (bit)
-			val ^= rm_30_14_rows[i];
-		/* we can skip the 'else' as XOR with 0 has no effect */
+		/* upper 14 bits identity matrix */
+		rm_30_14_rows[i] = (1 << (16+13 - i));
+		/* lower 16 bits from rm_30_14_gen */
+		rm_30_14_rows[i] |= shift_bits_together(rm_30_14_gen[i], 16);
 	}
-	return val;
+
+	/* breadth first from the zero syndrome, one error bit more on every
+	 * level, so each syndrome is first reached by a lightest pattern */
+	seen[0] = 1;
+	queue[tail++] = 0;
+	while (head < tail) {
+		uint16_t syn = queue[head++];
+
+		for (i = 0; i < 30; i++) {
+			uint32_t err = rm_syndrome_leader[syn] | (1 << i);
+			uint16_t next = rm_syndrome(err);
+
+			if (seen[next])
+				continue;
+			seen[next] = 1;
+			rm_syndrome_leader[next] = err;
+			queue[tail++] = next;
+		}
+	}
+}
+
+void tetra_rm3014_init(void)
+{
+	int i;
+
+	pthread_once(&rm_tables_once, rm_tables_init);
+
+	for (i = 0; i < 14; i++)
+		printf("rm_30_14_rows[%u] = 0x%08x\n", i, rm_30_14_rows[i]);
+}
+
+uint32_t tetra_rm3014_compute(const uint16_t in)
+{
+	pthread_once(&rm_tables_once, rm_tables_init);
+
+	return rm_compute(in);
 }
 
 /**
- * This is a systematic code. We can remove the control bits
- * and then check for an error. Maybe correct it in the future.
+ * This is a systematic code: the syndrome of the received word selects the
+ * most likely error pattern, which is removed before the control bits.
  */
 int tetra_rm3014_decode(const uint32_t inp, uint16_t *out)
 {
-	*out = inp >> 16;
-	return 0;
+	uint32_t err;
+
+	pthread_once(&rm_tables_once, rm_tables_init);
+
+	err = rm_syndrome_leader[rm_syndrome(inp)];
+	*out = (inp ^ err) >> 16;
+
+	return __builtin_popcount(err);
+}
+
+/* Chase decoding: every combination of the CHASE_BITS least reliable bits
+ * is flipped, the result syndrome decoded, and the candidate with the
+ * smallest sum of reliabilities of the bits it flips wins */
+int tetra_rm3014_decode_soft(const int8_t *sbits, uint16_t *out)
+{
+	uint8_t rel[30];
+	uint32_t hard = 0, best = 0;
+	uint32_t weak[CHASE_BITS];
+	unsigned int best_metric = UINT32_MAX;
+	int i, j;
+
+	pthread_once(&rm_tables_once, rm_tables_init);
+
+	for (i = 0; i < 30; i++) {
+		hard = (hard << 1) | (sbits[i] < 0);
+		rel[i] = sbits[i] < 0 ? -sbits[i] : sbits[i];
+		if (rel[i] > 127)
+			rel[i] = 127;
+	}
+
+	/* pick the least reliable bits by repeated selection, marking the
+	 * ones taken as most reliable */
+	for (j = 0; j < CHASE_BITS; j++) {
+		int min = 0;
+
+		for (i = 1; i < 30; i++) {
+			if (rel[i] < rel[min])
+				min = i;
+		}
+		weak[j] = min;
+		rel[min] |= 0x80;
+	}
+	for (i = 0; i < 30; i++)
+		rel[i] &= 0x7f;
+
+	for (j = 0; j < (1 << CHASE_BITS); j++) {
+		uint32_t word = hard, flips;
+		unsigned int metric = 0;
+		int k;
+
+		for (k = 0; k < CHASE_BITS; k++) {
+			if (j & (1 << k))
+				word ^= 1 << (29 - weak[k]);
+		}
+		word ^= rm_syndrome_leader[rm_syndrome(word)];
+
+		flips = word ^ hard;
+		for (k = 0; k < 30; k++) {
+			if (flips & (1 << (29 - k)))
+				metric += rel[k];
+		}
+		if (metric < best_metric) {
+			best_metric = metric;
+			best = word;
+		}
+	}
+
+	*out = best >> 16;
+
+	return __builtin_popcount(best ^ hard);
 }
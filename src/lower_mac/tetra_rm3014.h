@@ -3,14 +3,27 @@
 
 #include <stdint.h>
 
+/* the code has a minimum distance of 8, so up to 3 bit errors are
+ * corrected with certainty; more are only detected */
+#define RM3014_MAX_ERRORS	3
+
 void tetra_rm3014_init(void);
 uint32_t tetra_rm3014_compute(const uint16_t in);
 
 /**
- * Decode @param inp to @param out and return if there was
- * an error in the input. In the future this should correct
- * the error or such.
+ * Decode the 30 bit codeword @param inp (first transmitted bit in bit 29)
+ * to the 14 information bits in @param out.  Returns the number of bit
+ * errors corrected, more than RM3014_MAX_ERRORS means the block is most
+ * likely corrupt.
+ */
+int tetra_rm3014_decode(const uint32_t inp, uint16_t *out);
+
+/**
+ * Same for 30 soft bits (+127 = 0, -127 = 1) in transmission order: the
+ * least reliable bits are tried both ways and the codeword closest to the
+ * soft input is taken.  Returns the number of hard decisions it differs
+ * from.
  */
-int tetra_rm3013_decode(const uint32_t inp, uint16_t *out);
+int tetra_rm3014_decode_soft(const int8_t *sbits, uint16_t *out);
 
 #endif
@@ -21,67 +21,99 @@
  */
 
 #include <stdint.h>
-#include <lower_mac/tetra_scramb.h>
-
-/* Tap macro for the standard XOR / Fibonacci form */
-#define ST(x, y)	((x) >> (32-y))
+#include <string.h>
 
-/* Tap macro and constant for the Galois form */
-#define GL(x)		(1<<(x-1))
-#define GALOIS_LFSR	(GL(32)|GL(26)|GL(23)|GL(22)|GL(16)|GL(12)|GL(11)|GL(10)|GL(8)|GL(7)|GL(5)|GL(4)|GL(2)|GL(1))
+#include <lower_mac/tetra_scramb.h>
 
-#if 1
-static uint8_t next_lfsr_bit(uint32_t *lf)
+/* The scrambling LFSR in Fibonacci form, taps 32 26 23 22 16 12 11 10 8 7
+ * 5 4 2 1: every step computes
+ *
+ *	bit = (lfsr >> 0) ^ (lfsr >> 6) ^ (lfsr >> 9) ^ ... ^ (lfsr >> 31)
+ *	lfsr = (lfsr >> 1) | (bit << 31)
+ *
+ * and outputs 'bit'.  This is linear, so the next 32 output bits are a
+ * GF(2) matrix times the state.  Column j below is the output word of a
+ * state with only bit j set (bit k of an output word is the k-th bit
+ * generated).  After 32 steps the state has been shifted out completely,
+ * so the new state equals the output word. */
+static const uint32_t lfsr_word_cols[32] = {
+	0xc8851aab, 0x910a3556, 0x22146aac, 0x4428d558,
+	0x8851aab0, 0x10a35560, 0xe9c3b06b, 0xd38760d6,
+	0xa70ec1ac, 0x869899f3, 0xc5b4294d, 0x8b68529a,
+	0x16d0a534, 0x2da14a68, 0x5b4294d0, 0xb68529a0,
+	0xa58f49eb, 0x4b1e93d6, 0x963d27ac, 0x2c7a4f58,
+	0x9071841b, 0xe866129d, 0x18493f91, 0x30927f22,
+	0xa9a1e4ef, 0x9bc6d375, 0x378da6ea, 0xa79e577f,
+	0x87b9b455, 0x0f7368aa, 0xd663cbff, 0x64428d55,
+};
+
+static uint32_t next_lfsr_word(uint32_t *lf)
 {
-	uint32_t lfsr = *lf;
-	uint32_t bit;
+	uint32_t lfsr = *lf, word = 0;
+	int j;
 
-	/* taps: 32 26 23 22 16 12 11 10 8 7 5 4 2 1 */
-	bit = (ST(lfsr, 32) ^ ST(lfsr, 26) ^ ST(lfsr, 23) ^ ST(lfsr, 22) ^
-	       ST(lfsr, 16) ^ ST(lfsr, 12) ^ ST(lfsr, 11) ^ ST(lfsr, 10) ^
-	       ST(lfsr, 8) ^ ST(lfsr,  7) ^ ST(lfsr,  5) ^ ST(lfsr,  4) ^
-	       ST(lfsr, 2) ^ ST(lfsr,  1)) & 1;
-	lfsr = (lfsr >> 1) | (bit << 31);
+	for (j = 0; j < 32; j++)
+		word ^= lfsr_word_cols[j] & -((lfsr >> j) & 1);
 
 	/* update the caller's LFSR state */
-	*lf = lfsr;
+	*lf = word;
 
-	return bit & 0xff;
+	return word;
 }
-#else
-/* WARNING: this version somehow does not produce the desired result! */
-static uint8_t next_lfsr_bit(uint32_t *lf)
+
+int tetra_scramb_get_bits(uint32_t lfsr_init, uint8_t *out, int len)
 {
-	uint32_t lfsr = *lf;
-	uint32_t bit = lfsr & 1;
+	int i, k;
 
-	lfsr = (lfsr >> 1) ^ (uint32_t)(0 - ((lfsr & 1u) & GALOIS_LFSR));
+	for (i = 0; i < len; i += 32) {
+		uint32_t word = next_lfsr_word(&lfsr_init);
 
-	*lf = lfsr;
+		for (k = 0; k < 32 && i+k < len; k++)
+			out[i+k] = (word >> k) & 1;
+	}
 
-	return bit;
+	return 0;
 }
-#endif
 
-int tetra_scramb_get_bits(uint32_t lfsr_init, uint8_t *out, int len)
+/* XOR the bitstring at 'out/len' using the TETRA scrambling LFSR */
+int tetra_scramb_bits(uint32_t lfsr_init, uint8_t *out, int len)
 {
-	int i;
+	int i, k;
+
+	for (i = 0; i < len; i += 32) {
+		uint32_t word = next_lfsr_word(&lfsr_init);
 
-	for (i = 0; i < len; i++)
-		out[i] = next_lfsr_bit(&lfsr_init);
+		for (k = 0; k < 32 && i+k < len; k++)
+			out[i+k] ^= (word >> k) & 1;
+	}
 
 	return 0;
 }
 
-/* XOR the bitstring at 'out/len' using the TETRA scrambling LFSR */
-int tetra_scramb_bits(uint32_t lfsr_init, uint8_t *out, int len)
+const struct tetra_scramb_seq *tetra_scramb_seq_get(struct tetra_scramb_seq *seq,
+						    uint32_t lfsr_init)
+{
+	if (seq->valid && seq->lfsr_init == lfsr_init)
+		return seq;
+
+	tetra_scramb_get_bits(lfsr_init, seq->ubits, TETRA_SCRAMB_MAX_BITS);
+	seq->lfsr_init = lfsr_init;
+	seq->valid = 1;
+
+	return seq;
+}
+
+/* De-scramble 'len' soft bits from 'in' to 'out' with a cached sequence */
+void tetra_scramb_seq_sbits(const struct tetra_scramb_seq *seq, const int8_t *in,
+			    int8_t *out, int len)
 {
 	int i;
 
-	for (i = 0; i < len; i++)
-		out[i] ^= next_lfsr_bit(&lfsr_init);
+	for (i = 0; i < len; i++) {
+		int8_t flip = -seq->ubits[i];
 
-	return 0;
+		out[i] = (in[i] ^ flip) - flip;
+	}
 }
 
 uint32_t tetra_scramb_get_init(uint16_t mcc, uint16_t mnc, uint8_t colour)
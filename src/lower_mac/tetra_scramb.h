@@ -20,4 +20,24 @@ int tetra_scramb_get_bits(uint32_t lfsr_init, uint8_t *out, int len);
 /* XOR the bitstring at 'out/len' using the TETRA scrambling LFSR */
 int tetra_scramb_bits(uint32_t lfsr_init, uint8_t *out, int len);
 
+/* longest block that gets scrambled (SCH/F, 432 bits); shorter blocks use
+ * a prefix of the same sequence */
+#define TETRA_SCRAMB_MAX_BITS	432
+
+/* scrambling sequence of one scrambling code, cached per cell */
+struct tetra_scramb_seq {
+	int valid;
+	uint32_t lfsr_init;
+	uint8_t ubits[TETRA_SCRAMB_MAX_BITS];		/* one bit per byte */
+};
+
+/* return the sequence for 'lfsr_init', regenerating 'seq' if it was
+ * computed for a different code */
+const struct tetra_scramb_seq *tetra_scramb_seq_get(struct tetra_scramb_seq *seq,
+						    uint32_t lfsr_init);
+
+/* de-scramble 'len' soft bits from 'in' to 'out' with a cached sequence */
+void tetra_scramb_seq_sbits(const struct tetra_scramb_seq *seq, const int8_t *in,
+			    int8_t *out, int len);
+
 #endif /* TETRA_SCRAMB_H */
@@ -18,10 +18,8 @@
  */
 
 #include <stdint.h>
-#include <string.h>
-
-#include <osmocom/core/conv.h>
 
+#include <lower_mac/viterbi_k5.h>
 #include <lower_mac/viterbi_cch.h>
 
 
@@ -32,35 +30,27 @@
  * G4 = 1 + D      + D3 + D4
  */
 
-static const uint8_t conv_cch_next_output[][2] = {
-	{  0, 15 }, { 11,  4 }, {  6,  9 }, { 13,  2 },
-	{  5, 10 }, { 14,  1 }, {  3, 12 }, {  8,  7 },
-	{ 15,  0 }, {  4, 11 }, {  9,  6 }, {  2, 13 },
-	{ 10,  5 }, {  1, 14 }, { 12,  3 }, {  7,  8 },
-};
-
-static const uint8_t conv_cch_next_state[][2] = {
-	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
-	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
-	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 },
-	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 },
-};
-
-
-static const struct osmo_conv_code conv_cch = {
-	.N = 4,
-	.K = 5,
-	.next_output = conv_cch_next_output,
-	.next_state  = conv_cch_next_state,
-};
+/* taps as bit masks, bit i is D^i */
+static const struct viterbi_k5_code conv_cch =
+	VITERBI_K5_CODE(4, 0x13, 0x1d, 0x17, 0x1b);
 
 
 int conv_cch_decode(int8_t *input, uint8_t *output, int n)
 {
-	struct osmo_conv_code code;
+	return viterbi_k5_decode(&conv_cch, input, output, n);
+}
 
-	memcpy(&code, &conv_cch, sizeof(struct osmo_conv_code));
-	code.len = n;
+int conv_cch_decode_batch(int8_t * const *inputs, uint8_t * const *outputs, int n,
+			  unsigned int count)
+{
+	return viterbi_k5_decode_batch(&conv_cch, (const int8_t * const *) inputs,
+				       outputs, n, count);
+}
 
-	return osmo_conv_decode(&code, input, output);
+int conv_cch_decode_list(const int8_t *input, uint8_t *output, int n, unsigned int paths,
+			 unsigned int budget, void *mem, size_t mem_size,
+			 int (*check)(const uint8_t *out, void *priv), void *priv)
+{
+	return viterbi_k5_decode_list(&conv_cch, input, output, n, paths, budget,
+				      mem, mem_size, check, priv);
 }
@@ -1,7 +1,21 @@
 #ifndef VITERBI_CCH_H
 #define VITERBI_CCH_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 int conv_cch_encode(uint8_t *input, uint8_t *output, int n);
 int conv_cch_decode(int8_t *input, uint8_t *output, int n);
 
+/* decode 'count' blocks of n bits each */
+int conv_cch_decode_batch(int8_t * const *inputs, uint8_t * const *outputs, int n,
+			  unsigned int count);
+
+/* try the up to 'paths' most likely decodings of a block whose Viterbi
+ * decoding in 'output' failed, until check() accepts one,
+ * in 'mem' of viterbi_k5_list_mem_size() bytes, see viterbi_k5_decode_list() */
+int conv_cch_decode_list(const int8_t *input, uint8_t *output, int n, unsigned int paths,
+			 unsigned int budget, void *mem, size_t mem_size,
+			 int (*check)(const uint8_t *out, void *priv), void *priv);
+
 #endif /* VITERBI_CCH_H */
@@ -0,0 +1,432 @@
+/* Viterbi decoder for the 16-state (K=5) TETRA mother codes */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <lower_mac/viterbi_k5.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VK5_X86
+#include <immintrin.h>
+#endif
+
+/* number of trellis steps including the encoder flush */
+#define VK5_STEPS(n)	((n) + 4)
+
+/* Start metric of all states but 0.  A path from state 0 reaches every
+ * state within four steps and loses at most 4*N*128 = 2048 on the way, so
+ * paths from the other states never survive, while the int16 kernels stay
+ * far from saturation. */
+#define VK5_METRIC_INIT	(-8192)
+
+/* the SIMD kernels subtract the metric of state 0 at this interval */
+#define VK5_NORM_STEPS	8
+
+/* Follow the decisions back from state 0 after the flush.  Bit ns of
+ * dec[t] tells whether state ns was reached from (ns >> 1) | 8 at step t. */
+static void vk5_traceback(const uint16_t *dec, uint8_t *out, int n)
+{
+	unsigned int s = 0;
+	int t;
+
+	for (t = VK5_STEPS(n) - 1; t >= 0; t--) {
+		if (t < n)
+			out[t] = s & 1;
+		s = (s >> 1) | (((dec[t] >> s) & 1) << 3);
+	}
+}
+
+static void vk5_acs_scalar(const struct viterbi_k5_code *code, const int8_t *in,
+			   uint16_t *dec, int n)
+{
+	int32_t pm[VITERBI_K5_STATES], npm[VITERBI_K5_STATES];
+	unsigned int N = code->N;
+	unsigned int j;
+	int t, ns;
+
+	pm[0] = 0;
+	for (ns = 1; ns < VITERBI_K5_STATES; ns++)
+		pm[ns] = VK5_METRIC_INIT;
+
+	for (t = 0; t < VK5_STEPS(n); t++, in += N) {
+		uint16_t d = 0;
+
+		for (ns = 0; ns < VITERBI_K5_STATES; ns++) {
+			int32_t m0 = pm[ns >> 1], m1 = pm[(ns >> 1) | 8];
+
+			for (j = 0; j < N; j++) {
+				int16_t v = in[j];
+
+				m0 += (v ^ code->sign[0][j][ns]) - code->sign[0][j][ns];
+				m1 += (v ^ code->sign[1][j][ns]) - code->sign[1][j][ns];
+			}
+			if (m1 > m0) {
+				npm[ns] = m1;
+				d |= 1 << ns;
+			} else
+				npm[ns] = m0;
+		}
+		for (ns = 0; ns < VITERBI_K5_STATES; ns++)
+			pm[ns] = npm[ns];
+		dec[t] = d;
+	}
+}
+
+#ifdef VK5_X86
+/* SSE2: states 0..7 and 8..15 in one register each.  The predecessors
+ * (ns >> 1) of states 0..7 are states 0..3 each duplicated, which is what
+ * unpacklo(x, x) yields; unpackhi covers states 8..15. */
+__attribute__((target("sse2")))
+static void vk5_acs_sse2(const struct viterbi_k5_code *code, const int8_t *in,
+			 uint16_t *dec, int n)
+{
+	const __m128i *sign = (const __m128i *) code->sign;
+	unsigned int N = code->N;
+	__m128i lo = _mm_set_epi16(VK5_METRIC_INIT, VK5_METRIC_INIT, VK5_METRIC_INIT,
+				   VK5_METRIC_INIT, VK5_METRIC_INIT, VK5_METRIC_INIT,
+				   VK5_METRIC_INIT, 0);
+	__m128i hi = _mm_set1_epi16(VK5_METRIC_INIT);
+	unsigned int j;
+	int t;
+
+	for (t = 0; t < VK5_STEPS(n); t++, in += N) {
+		__m128i a_lo = _mm_unpacklo_epi16(lo, lo), a_hi = _mm_unpackhi_epi16(lo, lo);
+		__m128i b_lo = _mm_unpacklo_epi16(hi, hi), b_hi = _mm_unpackhi_epi16(hi, hi);
+		__m128i d_lo, d_hi;
+
+		for (j = 0; j < N; j++) {
+			__m128i v = _mm_set1_epi16(in[j]);
+			/* sign[p][j] is two registers, states 0..7 and 8..15 */
+			const __m128i *s0 = sign + 2*j, *s1 = sign + 2*(VITERBI_K5_MAX_N + j);
+
+			a_lo = _mm_adds_epi16(a_lo, _mm_sub_epi16(_mm_xor_si128(v, s0[0]), s0[0]));
+			a_hi = _mm_adds_epi16(a_hi, _mm_sub_epi16(_mm_xor_si128(v, s0[1]), s0[1]));
+			b_lo = _mm_adds_epi16(b_lo, _mm_sub_epi16(_mm_xor_si128(v, s1[0]), s1[0]));
+			b_hi = _mm_adds_epi16(b_hi, _mm_sub_epi16(_mm_xor_si128(v, s1[1]), s1[1]));
+		}
+
+		d_lo = _mm_cmpgt_epi16(b_lo, a_lo);
+		d_hi = _mm_cmpgt_epi16(b_hi, a_hi);
+		lo = _mm_max_epi16(a_lo, b_lo);
+		hi = _mm_max_epi16(a_hi, b_hi);
+		dec[t] = _mm_movemask_epi8(_mm_packs_epi16(d_lo, d_hi));
+
+		if (t % VK5_NORM_STEPS == VK5_NORM_STEPS - 1) {
+			__m128i m0 = _mm_shufflelo_epi16(lo, 0);
+
+			m0 = _mm_unpacklo_epi64(m0, m0);
+			lo = _mm_subs_epi16(lo, m0);
+			hi = _mm_subs_epi16(hi, m0);
+		}
+	}
+}
+
+/* AVX2: the SSE2 kernel for two blocks at once, one per 128-bit lane, so
+ * that all shuffles stay within a lane */
+__attribute__((target("avx2")))
+static void vk5_acs_avx2_x2(const struct viterbi_k5_code *code, const int8_t *in0,
+			    const int8_t *in1, uint16_t *dec0, uint16_t *dec1, int n)
+{
+	const __m128i *sign = (const __m128i *) code->sign;
+	unsigned int N = code->N;
+	__m256i s0[VITERBI_K5_MAX_N][2], s1[VITERBI_K5_MAX_N][2];
+	__m256i lo = _mm256_set_epi16(VK5_METRIC_INIT, VK5_METRIC_INIT, VK5_METRIC_INIT,
+				      VK5_METRIC_INIT, VK5_METRIC_INIT, VK5_METRIC_INIT,
+				      VK5_METRIC_INIT, 0,
+				      VK5_METRIC_INIT, VK5_METRIC_INIT, VK5_METRIC_INIT,
+				      VK5_METRIC_INIT, VK5_METRIC_INIT, VK5_METRIC_INIT,
+				      VK5_METRIC_INIT, 0);
+	__m256i hi = _mm256_set1_epi16(VK5_METRIC_INIT);
+	unsigned int j;
+	int t;
+
+	for (j = 0; j < N; j++) {
+		s0[j][0] = _mm256_broadcastsi128_si256(_mm_load_si128(sign + 2*j));
+		s0[j][1] = _mm256_broadcastsi128_si256(_mm_load_si128(sign + 2*j + 1));
+		s1[j][0] = _mm256_broadcastsi128_si256(_mm_load_si128(sign + 2*(VITERBI_K5_MAX_N + j)));
+		s1[j][1] = _mm256_broadcastsi128_si256(_mm_load_si128(sign + 2*(VITERBI_K5_MAX_N + j) + 1));
+	}
+
+	for (t = 0; t < VK5_STEPS(n); t++, in0 += N, in1 += N) {
+		__m256i a_lo = _mm256_unpacklo_epi16(lo, lo), a_hi = _mm256_unpackhi_epi16(lo, lo);
+		__m256i b_lo = _mm256_unpacklo_epi16(hi, hi), b_hi = _mm256_unpackhi_epi16(hi, hi);
+		__m256i d_lo, d_hi;
+		uint32_t d;
+
+		for (j = 0; j < N; j++) {
+			__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi16(in0[j])),
+							    _mm_set1_epi16(in1[j]), 1);
+
+			a_lo = _mm256_adds_epi16(a_lo, _mm256_sub_epi16(_mm256_xor_si256(v, s0[j][0]), s0[j][0]));
+			a_hi = _mm256_adds_epi16(a_hi, _mm256_sub_epi16(_mm256_xor_si256(v, s0[j][1]), s0[j][1]));
+			b_lo = _mm256_adds_epi16(b_lo, _mm256_sub_epi16(_mm256_xor_si256(v, s1[j][0]), s1[j][0]));
+			b_hi = _mm256_adds_epi16(b_hi, _mm256_sub_epi16(_mm256_xor_si256(v, s1[j][1]), s1[j][1]));
+		}
+
+		d_lo = _mm256_cmpgt_epi16(b_lo, a_lo);
+		d_hi = _mm256_cmpgt_epi16(b_hi, a_hi);
+		lo = _mm256_max_epi16(a_lo, b_lo);
+		hi = _mm256_max_epi16(a_hi, b_hi);
+		d = _mm256_movemask_epi8(_mm256_packs_epi16(d_lo, d_hi));
+		dec0[t] = d & 0xffff;
+		dec1[t] = d >> 16;
+
+		if (t % VK5_NORM_STEPS == VK5_NORM_STEPS - 1) {
+			__m256i m0 = _mm256_shufflelo_epi16(lo, 0);
+
+			m0 = _mm256_unpacklo_epi64(m0, m0);
+			lo = _mm256_subs_epi16(lo, m0);
+			hi = _mm256_subs_epi16(hi, m0);
+		}
+	}
+}
+
+static int vk5_have_sse2(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static int vk5_have_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+#endif /* VK5_X86 */
+
+int viterbi_k5_decode(const struct viterbi_k5_code *code, const int8_t *in,
+		      uint8_t *out, int n)
+{
+	if (n <= 0 || code->N > VITERBI_K5_MAX_N)
+		return -EINVAL;
+
+	uint16_t dec[VK5_STEPS(n)];
+
+#ifdef VK5_X86
+	if (vk5_have_sse2())
+		vk5_acs_sse2(code, in, dec, n);
+	else
+#endif
+		vk5_acs_scalar(code, in, dec, n);
+
+	vk5_traceback(dec, out, n);
+
+	return 0;
+}
+
+int viterbi_k5_decode_batch(const struct viterbi_k5_code *code, const int8_t * const *in,
+			    uint8_t * const *out, int n, unsigned int count)
+{
+	unsigned int i = 0;
+	int rc;
+
+	if (n <= 0 || code->N > VITERBI_K5_MAX_N)
+		return -EINVAL;
+
+#ifdef VK5_X86
+	if (vk5_have_avx2()) {
+		uint16_t dec0[VK5_STEPS(n)], dec1[VK5_STEPS(n)];
+
+		for (; i + 1 < count; i += 2) {
+			vk5_acs_avx2_x2(code, in[i], in[i+1], dec0, dec1, n);
+			vk5_traceback(dec0, out[i], n);
+			vk5_traceback(dec1, out[i+1], n);
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		rc = viterbi_k5_decode(code, in[i], out[i], n);
+		if (rc < 0)
+			return rc;
+	}
+
+	return 0;
+}
+
+/* metric of the states a path from state 0 cannot be in yet */
+#define VK5_LIST_NONE	(INT32_MIN / 2)
+
+/* A path of the list search, grown backwards from state 0 at the end of
+ * the trellis: its state at step t, the metric of its branches after t
+ * and the node it was grown from */
+struct vk5_node {
+	int32_t f;		/* metric of the best path through this node */
+	int32_t g;		/* metric from step t to the end */
+	uint16_t t;
+	uint8_t s;
+	int parent;
+};
+
+struct vk5_heap {
+	struct vk5_node *nodes;
+	int *heap;
+	unsigned int num_nodes, len;
+};
+
+/* branch metric of the branch into ns from (ns >> 1) | (p << 3) */
+static int32_t vk5_branch(const struct viterbi_k5_code *code, const int8_t *in,
+			  unsigned int ns, unsigned int p)
+{
+	int32_t m = 0;
+	unsigned int j;
+
+	for (j = 0; j < code->N; j++)
+		m += (in[j] ^ code->sign[p][j][ns]) - code->sign[p][j][ns];
+	return m;
+}
+
+static void vk5_heap_push(struct vk5_heap *h, int32_t g, unsigned int t, unsigned int s,
+			  int32_t alpha, int parent)
+{
+	struct vk5_node *nd = &h->nodes[h->num_nodes];
+	unsigned int i = h->len++;
+
+	nd->f = alpha + g;
+	nd->g = g;
+	nd->t = t;
+	nd->s = s;
+	nd->parent = parent;
+
+	/* sift up, the node with the best f on top */
+	while (i && h->nodes[h->heap[(i - 1) / 2]].f < nd->f) {
+		h->heap[i] = h->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	h->heap[i] = h->num_nodes++;
+}
+
+static int vk5_heap_pop(struct vk5_heap *h)
+{
+	int top = h->heap[0], last = h->heap[--h->len];
+	unsigned int i = 0, c;
+
+	while ((c = 2 * i + 1) < h->len) {
+		if (c + 1 < h->len && h->nodes[h->heap[c + 1]].f > h->nodes[h->heap[c]].f)
+			c++;
+		if (h->nodes[h->heap[c]].f <= h->nodes[last].f)
+			break;
+		h->heap[i] = h->heap[c];
+		i = c;
+	}
+	h->heap[i] = last;
+	return top;
+}
+
+/* the budget of a search, 0 if the arguments exceed the limits */
+static size_t vk5_list_budget(int n, unsigned int paths, unsigned int budget)
+{
+	size_t all;
+
+	if (n <= 0 || n > VITERBI_K5_LIST_MAX_BITS || !paths ||
+	    paths > VITERBI_K5_LIST_MAX_PATHS || budget > VITERBI_K5_LIST_MAX_BUDGET)
+		return 0;
+	if (budget)
+		return budget;
+	all = (size_t) paths * VK5_STEPS(n);
+	return all < VITERBI_K5_LIST_MAX_BUDGET ? all : VITERBI_K5_LIST_MAX_BUDGET;
+}
+
+size_t viterbi_k5_list_mem_size(int n, unsigned int paths, unsigned int budget)
+{
+	size_t max_nodes = 2 * vk5_list_budget(n, paths, budget) + 1;
+
+	if (max_nodes == 1)
+		return 0;
+	/* every node taken pushes at most two */
+	return max_nodes * (sizeof(struct vk5_node) + sizeof(int));
+}
+
+/* Tree-trellis search (Soong and Huang): the forward pass keeps the best
+ * metric of every state at every step, with which a best first search
+ * backwards from the end yields the complete paths exactly in the order of
+ * their metrics.  Every node taken from the heap costs one unit of the
+ * budget. */
+int viterbi_k5_decode_list(const struct viterbi_k5_code *code, const int8_t *in,
+			   uint8_t *out, int n, unsigned int paths, unsigned int budget,
+			   void *mem, size_t mem_size,
+			   int (*check)(const uint8_t *out, void *priv), void *priv)
+{
+	int32_t alpha[VK5_STEPS(VITERBI_K5_LIST_MAX_BITS) + 1][VITERBI_K5_STATES];
+	uint8_t path[VITERBI_K5_LIST_MAX_BITS];
+	unsigned int N = code->N, steps, rank = 0, t, ns;
+	size_t nodes_left, size;
+	struct vk5_heap h;
+
+	size = viterbi_k5_list_mem_size(n, paths, budget);
+	if (!size || size > mem_size || code->N > VITERBI_K5_MAX_N)
+		return -EINVAL;
+	steps = VK5_STEPS(n);
+	nodes_left = vk5_list_budget(n, paths, budget);
+
+	alpha[0][0] = 0;
+	for (ns = 1; ns < VITERBI_K5_STATES; ns++)
+		alpha[0][ns] = VK5_LIST_NONE;
+
+	for (t = 0; t < steps; t++) {
+		for (ns = 0; ns < VITERBI_K5_STATES; ns++) {
+			int32_t m0 = alpha[t][ns >> 1], m1 = alpha[t][(ns >> 1) | 8];
+
+			m0 += vk5_branch(code, in + t * N, ns, 0);
+			m1 += vk5_branch(code, in + t * N, ns, 1);
+			alpha[t + 1][ns] = m1 > m0 ? m1 : m0;
+		}
+	}
+
+	/* every node taken pushes at most two */
+	h.nodes = mem;
+	h.heap = (int *) (h.nodes + 2 * nodes_left + 1);
+	h.num_nodes = h.len = 0;
+	vk5_heap_push(&h, 0, steps, 0, alpha[steps][0], -1);
+
+	while (h.len && nodes_left--) {
+		int i = vk5_heap_pop(&h);
+		const struct vk5_node *nd = &h.nodes[i];
+		unsigned int p;
+
+		if (nd->t == 0) {
+			/* a complete path, next best after the ones before */
+			for (; nd->parent >= 0; nd = &h.nodes[nd->parent]) {
+				const struct vk5_node *up = &h.nodes[nd->parent];
+
+				if (up->t <= n)
+					path[up->t - 1] = up->s & 1;
+			}
+			/* the best one is the caller's Viterbi decoding, but
+			 * for paths of equal metric */
+			if ((++rank > 1 || memcmp(path, out, n)) && check(path, priv)) {
+				memcpy(out, path, n);
+				return rank;
+			}
+			if (rank == paths)
+				break;
+			continue;
+		}
+
+		for (p = 0; p < 2; p++) {
+			unsigned int ps = (nd->s >> 1) | (p << 3);
+			int32_t a = alpha[nd->t - 1][ps];
+
+			if (a <= VK5_LIST_NONE / 2)
+				continue;
+			vk5_heap_push(&h, nd->g + vk5_branch(code, in + (nd->t - 1) * N, nd->s, p),
+				      nd->t - 1, ps, a, i);
+		}
+	}
+
+	return 0;
+}
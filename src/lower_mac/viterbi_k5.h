@@ -0,0 +1,76 @@
+#ifndef VITERBI_K5_H
+#define VITERBI_K5_H
+/* Viterbi decoder for the 16-state (K=5) TETRA mother codes */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define VITERBI_K5_STATES	16
+#define VITERBI_K5_MAX_N	4
+
+/* A K=5 rate 1/N code whose encoder state is the last four input bits,
+ * newest in bit 0, i.e. next_state = ((state << 1) | bit) & 15.  A state
+ * ns is then reached from (ns >> 1) and from (ns >> 1) | 8. */
+struct viterbi_k5_code {
+	unsigned int N;
+	/* sign[p][j][ns] is -1 if output bit j of the branch into state ns
+	 * from predecessor (ns >> 1) | (p << 3) is 1, and 0 otherwise */
+	int16_t sign[2][VITERBI_K5_MAX_N][VITERBI_K5_STATES] __attribute__((aligned(16)));
+};
+
+/* Generator polynomials have bit i set for the D^i tap (bit 0 is the
+ * current input), g0 gives the first output bit of each step.  A zero
+ * generator describes an output bit that is always 0. */
+#define VK5_PARITY(x)	(((x) ^ ((x) >> 1) ^ ((x) >> 2) ^ ((x) >> 3) ^ ((x) >> 4)) & 1)
+#define VK5_SIGN(g, p, ns)	(VK5_PARITY(((ns) | ((p) << 4)) & (g)) ? -1 : 0)
+#define VK5_ROW(g, p)	{ \
+	VK5_SIGN(g, p,  0), VK5_SIGN(g, p,  1), VK5_SIGN(g, p,  2), VK5_SIGN(g, p,  3), \
+	VK5_SIGN(g, p,  4), VK5_SIGN(g, p,  5), VK5_SIGN(g, p,  6), VK5_SIGN(g, p,  7), \
+	VK5_SIGN(g, p,  8), VK5_SIGN(g, p,  9), VK5_SIGN(g, p, 10), VK5_SIGN(g, p, 11), \
+	VK5_SIGN(g, p, 12), VK5_SIGN(g, p, 13), VK5_SIGN(g, p, 14), VK5_SIGN(g, p, 15) }
+
+#define VITERBI_K5_CODE(n, g0, g1, g2, g3)	{				\
+	.N = (n),								\
+	.sign = {								\
+		{ VK5_ROW(g0, 0), VK5_ROW(g1, 0), VK5_ROW(g2, 0), VK5_ROW(g3, 0) },	\
+		{ VK5_ROW(g0, 1), VK5_ROW(g1, 1), VK5_ROW(g2, 1), VK5_ROW(g3, 1) },	\
+	},									\
+}
+
+/* Decode 'n' bits from (n + 4) * N soft bits (+127 = 0, -127 = 1, 0 =
+ * erasure).  Like osmo_conv_decode() with CONV_TERM_FLUSH, the last four
+ * steps are the encoder flush and the path ending in state 0 is chosen. */
+int viterbi_k5_decode(const struct viterbi_k5_code *code, const int8_t *in,
+		      uint8_t *out, int n);
+
+/* Decode 'count' blocks of the same length; with AVX2 two blocks share
+ * one pass through the trellis */
+int viterbi_k5_decode_batch(const struct viterbi_k5_code *code, const int8_t * const *in,
+			    uint8_t * const *out, int n, unsigned int count);
+
+/* limits of the list search: the longest block (SCH/F, 268 type-1 bits
+ * and the CRC), the decodings and the trellis nodes searched */
+#define VITERBI_K5_LIST_MAX_BITS	284
+#define VITERBI_K5_LIST_MAX_PATHS	1024
+#define VITERBI_K5_LIST_MAX_BUDGET	(1 << 16)
+
+/* bytes of 'mem' viterbi_k5_decode_list() needs for these arguments, about
+ * 40 per trellis node of the budget; 0 if they exceed the limits */
+size_t viterbi_k5_list_mem_size(int n, unsigned int paths, unsigned int budget);
+
+/* List Viterbi decoding of a block whose Viterbi decoding, passed in
+ * 'out', the caller already found wanting: hand the up to 'paths' most
+ * likely decodings of 'n' bits, best first, to check() until it accepts
+ * one by returning non-zero.  The best one is only checked where it
+ * differs from 'out', which paths of equal metric allow.  The search gives up after 'budget'
+ * trellis nodes, 0 allows paths * (n + 4) up to
+ * VITERBI_K5_LIST_MAX_BUDGET.  It works in the caller's 'mem', so that
+ * the storage can be kept from one block to the next.  Returns the rank
+ * of the accepted decoding, left in 'out', 0 if none was accepted, or
+ * -EINVAL if the arguments exceed the limits or 'mem_size'. */
+int viterbi_k5_decode_list(const struct viterbi_k5_code *code, const int8_t *in,
+			   uint8_t *out, int n, unsigned int paths, unsigned int budget,
+			   void *mem, size_t mem_size,
+			   int (*check)(const uint8_t *out, void *priv), void *priv);
+
+#endif /* VITERBI_K5_H */
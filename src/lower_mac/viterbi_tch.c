@@ -18,10 +18,8 @@
  */
 
 #include <stdint.h>
-#include <string.h>
-
-#include <osmocom/core/conv.h>
 
+#include <lower_mac/viterbi_k5.h>
 #include <lower_mac/viterbi_tch.h>
 
 
@@ -31,34 +29,37 @@
  * G3 = 1     + D2      + D4
  */
 
-static const uint8_t conv_tch_next_output[][2] = {
-	{ 0, 7 }, { 6, 1 }, { 5, 2 }, { 3, 4 }, 
-	{ 6, 1 }, { 0, 7 }, { 3, 4 }, { 5, 2 }, 
-	{ 7, 0 }, { 1, 6 }, { 2, 5 }, { 4, 3 }, 
-	{ 1, 6 }, { 7, 0 }, { 4, 3 }, { 2, 5 }, 
-};
+/* taps as bit masks, bit i is D^i.  The mother code is used with N = 4
+ * symbols per step, the first of which is always 0. */
+static const struct viterbi_k5_code conv_tch =
+	VITERBI_K5_CODE(4, 0, 0x1f, 0x1b, 0x15);
+
 
-static const uint8_t conv_tch_next_state[][2] = {
-	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 }, 
-	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 }, 
-	{  0,  1 }, {  2,  3 }, {  4,  5 }, {  6,  7 }, 
-	{  8,  9 }, { 10, 11 }, { 12, 13 }, { 14, 15 }, 
-};
+/* n input bits and the four flush bits, laid out like the decoder input */
+int conv_tch_encode(uint8_t *input, uint8_t *output, int n)
+{
+	unsigned int reg = 0;
+	int i;
 
-static const struct osmo_conv_code conv_tch = {
-	.N = 4,
-	.K = 5,
-	.next_output = conv_tch_next_output,
-	.next_state  = conv_tch_next_state,
-};
+	for (i = 0; i < n + 4; i++) {
+		reg = ((reg << 1) | (i < n ? input[i] : 0)) & 0x1f;
+		*output++ = 0;
+		*output++ = __builtin_parity(reg & 0x1f);
+		*output++ = __builtin_parity(reg & 0x1b);
+		*output++ = __builtin_parity(reg & 0x15);
+	}
 
+	return 0;
+}
 
 int conv_tch_decode(int8_t *input, uint8_t *output, int n)
 {
-	struct osmo_conv_code code;
-
-	memcpy(&code, &conv_tch, sizeof(struct osmo_conv_code));
-	code.len = n;
+	return viterbi_k5_decode(&conv_tch, input, output, n);
+}
 
-	return osmo_conv_decode(&code, input, output);
+int conv_tch_decode_batch(int8_t * const *inputs, uint8_t * const *outputs, int n,
+			  unsigned int count)
+{
+	return viterbi_k5_decode_batch(&conv_tch, (const int8_t * const *) inputs,
+				       outputs, n, count);
 }
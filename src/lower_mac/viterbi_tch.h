@@ -4,4 +4,8 @@
 int conv_tch_encode(uint8_t *input, uint8_t *output, int n);
 int conv_tch_decode(int8_t *input, uint8_t *output, int n);
 
+/* decode 'count' blocks of n bits each */
+int conv_tch_decode_batch(int8_t * const *inputs, uint8_t * const *outputs, int n,
+			  unsigned int count);
+
 #endif /* VITERBI_TCH_H */
@@ -24,6 +24,9 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <osmocom/core/utils.h>
+#include <osmocom/core/bits.h>
+
 #include <phy/tetra_burst.h>
 #include <tetra_common.h>
 
@@ -151,7 +154,7 @@ int32_t sum_up_phase(const uint8_t *bits, unsigned int sym_count)
 		sum_phase += bits2phase[sym_in];
 	}
 
-	printf("phase sum over %u symbols: %dpi/4, mod 8 = %dpi/4, wrap = %dpi/4\n",
+	TLOGP(TLOG_PHY, TLOGL_DEBUG, "phase sum over %u symbols: %dpi/4, mod 8 = %dpi/4, wrap = %dpi/4\n",
 		sym_count, sum_phase, sum_phase % 8, calc_phase_adj(sum_phase));
 	return sum_phase;
 }
@@ -274,82 +277,227 @@ int build_norm_c_d_burst(uint8_t *buf, const uint8_t *bkn1, const uint8_t *bb, c
 	return cur - buf;
 }
 
-int tetra_find_train_seq(const uint8_t *in, unsigned int end_of_in,
-			 uint32_t mask_of_train_seq, unsigned int *offset)
+/* training sequences in the order in which tetra_find_train_seq() checks them */
+static const struct {
+	enum tetra_train_seq type;
+	const uint8_t *bits;
+	unsigned int len;
+} train_seqs[] = {
+	{ TETRA_TRAIN_SYNC,	y_bits, sizeof(y_bits) },
+	{ TETRA_TRAIN_NORM_1,	n_bits, sizeof(n_bits) },
+	{ TETRA_TRAIN_NORM_2,	p_bits, sizeof(p_bits) },
+	{ TETRA_TRAIN_NORM_3,	q_bits, sizeof(q_bits) },
+	{ TETRA_TRAIN_EXT,	x_bits, sizeof(x_bits) },
+};
+
+#define TRAIN_SEQ_MAX_LEN	38
+/* bit-sliced error counters, enough planes for TRAIN_SEQ_MAX_LEN */
+#define CORR_PLANES		6
+
+/* The correlator works on 64-bit words holding the input stream MSB first,
+ * i.e. bit n of the stream is bit (63 - n%64) of word n/64.  Each step
+ * evaluates 64 consecutive candidate offsets at once: for every bit j of
+ * the training sequence, the 64 input bits at offset+j are XORed with the
+ * expected bit and added into a bit-sliced counter per offset. */
+
+/* 64 stream bits starting at bit position 'pos' */
+static inline uint64_t corr_window(const uint64_t *words, unsigned int pos)
 {
-	static uint32_t tsq_bytes[5];
-
-	if (tsq_bytes[0] == 0) {
-#define FILTER_LOOKAHEAD_LEN 22
-#define FILTER_LOOKAHEAD_MASK ((1<<FILTER_LOOKAHEAD_LEN)-1)
-		for (int i = 0; i < FILTER_LOOKAHEAD_LEN; i++) {
-			tsq_bytes[0] = (tsq_bytes[0] << 1) | y_bits[i];
-			tsq_bytes[1] = (tsq_bytes[1] << 1) | n_bits[i];
-			tsq_bytes[2] = (tsq_bytes[2] << 1) | p_bits[i];
-			tsq_bytes[3] = (tsq_bytes[3] << 1) | q_bits[i];
-			tsq_bytes[4] = (tsq_bytes[4] << 1) | x_bits[i];
-		}
-	}
+	unsigned int idx = pos / 64, sh = pos % 64;
+
+	if (!sh)
+		return words[idx];
+	return (words[idx] << sh) | (words[idx+1] >> (64 - sh));
+}
+
+static inline void corr_add(uint64_t *cnt, uint64_t err)
+{
+	int b;
 
-	uint32_t filter = 0;
+	for (b = 0; b < CORR_PLANES && err; b++) {
+		uint64_t carry = cnt[b] & err;
+		cnt[b] ^= err;
+		err = carry;
+	}
+}
 
-	for (int i = 0; i < FILTER_LOOKAHEAD_LEN-2; i++)
-		filter = (filter << 1) | in[i];
+/* lanes whose counter is <= max */
+static inline uint64_t corr_le(const uint64_t *cnt, unsigned int max)
+{
+	uint64_t gt = 0, eq = ~(uint64_t)0;
+	int b;
+
+	if (max >= (1 << CORR_PLANES) - 1)
+		return eq;
+
+	for (b = CORR_PLANES-1; b >= 0; b--) {
+		if (max & (1 << b))
+			eq &= cnt[b];
+		else {
+			gt |= eq & cnt[b];
+			eq &= ~cnt[b];
+		}
+	}
+	return ~gt;
+}
 
-	const uint8_t *cur;
+static inline unsigned int corr_lane_count(const uint64_t *cnt, unsigned int lane)
+{
+	unsigned int b, n = 0;
 
-	for (cur = in; cur < in + end_of_in; cur++) {
-		filter = ((filter << 1) | cur[FILTER_LOOKAHEAD_LEN-1]) & FILTER_LOOKAHEAD_MASK;
+	for (b = 0; b < CORR_PLANES; b++)
+		n |= ((cnt[b] >> (63 - lane)) & 1) << b;
 
-		int match = 0;
+	return n;
+}
 
-		for (int i = 0; i < 5; i++)
-			if (filter == tsq_bytes[i])
-				match = 1;
+static uint32_t correlate_words(const uint64_t *words, unsigned int end_of_in,
+				uint32_t mask_of_train_seq, unsigned int max_errors,
+				struct tetra_train_seq_match *match)
+{
+	uint32_t found = 0, wanted = 0;
+	unsigned int s, j, base, maxlen = 0;
 
-		if (!match)
+	for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+		if (!(mask_of_train_seq & (1 << train_seqs[s].type)) ||
+		    train_seqs[s].len > end_of_in)
 			continue;
+		wanted |= 1 << s;
+		if (train_seqs[s].len > maxlen)
+			maxlen = train_seqs[s].len;
+	}
 
-		int remain_len = (in + end_of_in) - cur;
+	for (base = 0; wanted && base + maxlen <= end_of_in + 63; base += 64) {
+		uint64_t cnt[ARRAY_SIZE(train_seqs)][CORR_PLANES];
 
-		if (mask_of_train_seq & (1 << TETRA_TRAIN_SYNC) &&
-		    remain_len >= sizeof(y_bits) &&
-		    !memcmp(cur, y_bits, sizeof(y_bits))) {
-			*offset = (cur - in);
-			return TETRA_TRAIN_SYNC;
-		}
-		if (mask_of_train_seq & (1 << TETRA_TRAIN_NORM_1) &&
-		    remain_len >= sizeof(n_bits) &&
-		    !memcmp(cur, n_bits, sizeof(n_bits))) {
-			*offset = (cur - in);
-			return TETRA_TRAIN_NORM_1;
-		}
-		if (mask_of_train_seq & (1 << TETRA_TRAIN_NORM_2) &&
-		    remain_len >= sizeof(p_bits) &&
-		    !memcmp(cur, p_bits, sizeof(p_bits))) {
-			*offset = (cur - in);
-			return TETRA_TRAIN_NORM_2;
+		memset(cnt, 0, sizeof(cnt));
+		for (j = 0; j < maxlen; j++) {
+			uint64_t w = corr_window(words, base + j);
+
+			for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+				if (!(wanted & (1 << s)) || j >= train_seqs[s].len)
+					continue;
+				corr_add(cnt[s], train_seqs[s].bits[j] ? ~w : w);
+			}
 		}
-		if (mask_of_train_seq & (1 << TETRA_TRAIN_NORM_3) &&
-		    remain_len >= sizeof(q_bits) &&
-		    !memcmp(cur, q_bits, sizeof(q_bits))) {
-			*offset = (cur - in);
-			return TETRA_TRAIN_NORM_3;
+
+		for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+			struct tetra_train_seq_match *m = &match[train_seqs[s].type];
+			unsigned int len = train_seqs[s].len;
+			uint64_t cand;
+
+			if (!(wanted & (1 << s)))
+				continue;
+
+			cand = corr_le(cnt[s], max_errors);
+			/* only offsets at which the whole sequence fits */
+			if (base + len > end_of_in + 1)
+				cand = 0;
+			else if (end_of_in + 1 - (base + len) < 64)
+				cand &= ~(~(uint64_t)0 >> (end_of_in + 1 - (base + len)));
+
+			while (cand) {
+				unsigned int lane = __builtin_clzll(cand);
+				unsigned int errors = corr_lane_count(cnt[s], lane);
+
+				cand &= ~((uint64_t)1 << (63 - lane));
+				if ((found & (1 << s)) && errors >= m->errors)
+					continue;
+				found |= 1 << s;
+				m->offset = base + lane;
+				m->errors = errors;
+				if (errors == 0) {
+					/* nothing can beat the earliest exact match */
+					wanted &= ~(1 << s);
+					break;
+				}
+			}
 		}
-		if (mask_of_train_seq & (1 << TETRA_TRAIN_EXT) &&
-		    remain_len >= sizeof(x_bits) &&
-		    !memcmp(cur, x_bits, sizeof(x_bits))) {
-			*offset = (cur - in);
-			return TETRA_TRAIN_EXT;
+	}
+
+	/* translate from table index to training sequence mask */
+	mask_of_train_seq = 0;
+	for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+		if (found & (1 << s))
+			mask_of_train_seq |= 1 << train_seqs[s].type;
+	}
+	return mask_of_train_seq;
+}
+
+/* pack one-bit-per-byte input into MSB first words, plus zero words of
+ * padding for corr_window() beyond the end of the input */
+#define CORR_PAD_WORDS	2
+
+static void ubits_to_words(const uint8_t *in, unsigned int len, uint64_t *words)
+{
+	unsigned int i, nwords = (len + 63) / 64;
+
+	memset(words, 0, (nwords + CORR_PAD_WORDS) * sizeof(*words));
+	for (i = 0; i + 8 <= len; i += 8) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		uint64_t x;
+
+		/* gather the LSB of eight bytes into one byte, first bit on top */
+		memcpy(&x, in + i, 8);
+		x = ((x & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+#else
+		uint64_t x = 0;
+		int b;
+
+		for (b = 0; b < 8; b++)
+			x = (x << 1) | (in[i+b] & 1);
+#endif
+		words[i/64] |= x << (56 - (i % 64));
+	}
+	for (; i < len; i++)
+		words[i/64] |= (uint64_t)(in[i] & 1) << (63 - (i % 64));
+}
+
+uint32_t tetra_correlate_train_seq(const uint8_t *in, unsigned int end_of_in,
+				   uint32_t mask_of_train_seq, unsigned int max_errors,
+				   struct tetra_train_seq_match *match)
+{
+	uint64_t words[(end_of_in + 63) / 64 + CORR_PAD_WORDS];
+
+	ubits_to_words(in, end_of_in, words);
+
+	return correlate_words(words, end_of_in, mask_of_train_seq, max_errors, match);
+}
+
+/* pick the earliest exact match, in train_seqs[] order for equal offsets */
+static int first_exact_match(uint32_t found, const struct tetra_train_seq_match *match,
+			     unsigned int *offset)
+{
+	int s, best = -1;
+
+	for (s = 0; s < ARRAY_SIZE(train_seqs); s++) {
+		enum tetra_train_seq type = train_seqs[s].type;
+
+		if (!(found & (1 << type)))
+			continue;
+		if (best < 0 || match[type].offset < *offset) {
+			best = type;
+			*offset = match[type].offset;
 		}
 	}
-	return -1;
+	return best;
 }
 
-void tetra_burst_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv)
+int tetra_find_train_seq(const uint8_t *in, unsigned int end_of_in,
+			 uint32_t mask_of_train_seq, unsigned int *offset)
 {
-	uint8_t bbk_buf[NDB_BBK_BITS];
-	uint8_t ndbf_buf[2*NDB_BLK_BITS];
+	struct tetra_train_seq_match match[TETRA_TRAIN_EXT+1];
+	uint32_t found;
+
+	found = tetra_correlate_train_seq(in, end_of_in, mask_of_train_seq, 0, match);
+
+	return first_exact_match(found, match, offset);
+}
+
+void tetra_burst_rx_cb(const int8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv)
+{
+	int8_t bbk_buf[NDB_BBK_BITS];
+	int8_t ndbf_buf[2*NDB_BLK_BITS];
 
 	switch (type) {
 	case TETRA_TRAIN_SYNC:
@@ -385,10 +533,10 @@ void tetra_burst_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_
 	}
 }
 
-void tetra_burst_dmo_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv)
+void tetra_burst_dmo_rx_cb(const int8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv)
 {
-	uint8_t bbk_buf[NDB_BBK_BITS];
-	uint8_t ndbf_buf[2*NDB_BLK_BITS];
+	int8_t bbk_buf[NDB_BBK_BITS];
+	int8_t ndbf_buf[2*NDB_BLK_BITS];
 
 	switch (type) {
 	case TETRA_TRAIN_SYNC:
@@ -421,4 +569,76 @@ void tetra_burst_dmo_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_tr
 		// did we forgot something?
 		break;
 	}
-}
\ No newline at end of file
+}
+
+/* number of bursts split into blocks before they go to the lower MAC */
+#define BURST_BATCH	8
+
+void tetra_burst_rx_batch(const int8_t *bursts, const enum tetra_train_seq *types,
+			  unsigned int count, void *priv)
+{
+	struct tetra_mac_state *tms = priv;
+	int dmo = tms->infra_mode == TETRA_INFRA_DMO;
+	int8_t bbk_buf[BURST_BATCH][NDB_BBK_BITS];
+	int8_t ndbf_buf[BURST_BATCH][2*NDB_BLK_BITS];
+	struct tetra_sap_blk blks[BURST_BATCH*3];
+	unsigned int tn_adv = 0, nblks = 0, i, b = 0;
+
+#define ADD_BLK(_dp, _type, _bits, _len) do {			\
+		blks[nblks].dp = _dp;				\
+		blks[nblks].type = _type;			\
+		blks[nblks].tn_adv = tn_adv;			\
+		blks[nblks].bits = _bits;			\
+		blks[nblks].len = _len;				\
+		nblks++;					\
+		tn_adv = 0;					\
+	} while (0)
+
+	for (i = 0; i < count; i++) {
+		const int8_t *burst = bursts + i * TETRA_BITS_PER_TS;
+
+		tn_adv++;
+
+		switch (types[i]) {
+		case TETRA_TRAIN_SYNC:
+			if (dmo) {
+				ADD_BLK(1, DPSAP_T_DSB1, burst+DMO_SB_BLK1_OFFSET, DMO_SB_BLK1_BITS);
+				ADD_BLK(1, DPSAP_T_DSB2, burst+DMO_SB_BLK2_OFFSET, DMO_SB_BLK2_BITS);
+			} else {
+				ADD_BLK(0, TPSAP_T_SB1, burst+SB_BLK1_OFFSET, SB_BLK1_BITS);
+				ADD_BLK(0, TPSAP_T_BBK, burst+SB_BBK_OFFSET, SB_BBK_BITS);
+				ADD_BLK(0, TPSAP_T_SB2, burst+SB_BLK2_OFFSET, SB_BLK2_BITS);
+			}
+			break;
+		case TETRA_TRAIN_NORM_2:
+			memcpy(bbk_buf[b], burst+NDB_BBK1_OFFSET, NDB_BBK1_BITS);
+			memcpy(bbk_buf[b]+NDB_BBK1_BITS, burst+NDB_BBK2_OFFSET, NDB_BBK2_BITS);
+			ADD_BLK(0, TPSAP_T_BBK, bbk_buf[b], NDB_BBK_BITS);
+			ADD_BLK(0, TPSAP_T_NDB, burst+NDB_BLK1_OFFSET, NDB_BLK_BITS);
+			ADD_BLK(0, TPSAP_T_NDB, burst+NDB_BLK2_OFFSET, NDB_BLK_BITS);
+			break;
+		case TETRA_TRAIN_NORM_1:
+			memcpy(bbk_buf[b], burst+NDB_BBK1_OFFSET, NDB_BBK1_BITS);
+			memcpy(bbk_buf[b]+NDB_BBK1_BITS, burst+NDB_BBK2_OFFSET, NDB_BBK2_BITS);
+			memcpy(ndbf_buf[b], burst+NDB_BLK1_OFFSET, NDB_BLK_BITS);
+			memcpy(ndbf_buf[b]+NDB_BLK_BITS, burst+NDB_BLK2_OFFSET, NDB_BLK_BITS);
+			ADD_BLK(0, TPSAP_T_BBK, bbk_buf[b], NDB_BBK_BITS);
+			ADD_BLK(0, TPSAP_T_SCH_F, ndbf_buf[b], 2*NDB_BLK_BITS);
+			break;
+		default:
+			/* no blocks, the time still advances with the next one */
+			break;
+		}
+
+		if (++b == BURST_BATCH || i == count - 1) {
+			tp_sap_udata_ind_batch(blks, nblks, priv);
+			nblks = 0;
+			b = 0;
+		}
+	}
+#undef ADD_BLK
+
+	/* bursts without any blocks at the very end */
+	if (tn_adv)
+		tetra_tdma_time_add_tn(&tms->phy_state.time, tn_adv);
+}
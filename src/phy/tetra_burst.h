@@ -22,8 +22,22 @@ enum dp_sap_data_type {
 };
 
 
-extern void dp_sap_udata_ind(enum dp_sap_data_type type, const uint8_t *bits, unsigned int len, void *priv);
-extern void tp_sap_udata_ind(enum tp_sap_data_type type, const uint8_t *bits, unsigned int len, void *priv);
+/* the PHY hands soft bits (+127 = 0, -127 = 1, 0 = erasure) to the lower MAC */
+extern void dp_sap_udata_ind(enum dp_sap_data_type type, const int8_t *bits, unsigned int len, void *priv);
+extern void tp_sap_udata_ind(enum tp_sap_data_type type, const int8_t *bits, unsigned int len, void *priv);
+
+/* one block of a burst on its way from the PHY into the lower MAC */
+struct tetra_sap_blk {
+	uint8_t dp;		/* DP-SAP (DMO synchronization burst), else TP-SAP */
+	uint8_t type;		/* enum dp_sap_data_type resp. enum tp_sap_data_type */
+	uint8_t tn_adv;		/* timeslots the PHY time advances by before this block */
+	const int8_t *bits;
+	unsigned int len;
+};
+
+/* the blocks of a run of bursts in one call, for the lower MAC to decode
+ * stage by stage across all of them */
+extern void tp_sap_udata_ind_batch(const struct tetra_sap_blk *blks, unsigned int count, void *priv);
 
 /* 9.4.4.2.6 Synchronization continuous downlink burst */
 int build_sync_c_d_burst(uint8_t *buf, const uint8_t *sb, const uint8_t *bb, const uint8_t *bkn);
@@ -39,8 +53,30 @@ enum tetra_train_seq {
 	TETRA_TRAIN_EXT,
 };
 
+/* Decode 'count' consecutive bursts of TETRA_BITS_PER_TS soft bits each,
+ * aligned to the burst start, burst i carrying training sequence types[i].
+ * Same result as the burst callbacks of the synchronizer, including the
+ * PHY time advancing by one timeslot per burst, but batched through the
+ * lower MAC.  'priv' is the struct tetra_mac_state of the receiver. */
+void tetra_burst_rx_batch(const int8_t *bursts, const enum tetra_train_seq *types,
+			  unsigned int count, void *priv);
+
 /* find a TETRA training sequence in the burst buffer indicated */
 int tetra_find_train_seq(const uint8_t *in, unsigned int end_of_in,
 			 uint32_t mask_of_train_seq, unsigned int *offset);
 
+struct tetra_train_seq_match {
+	unsigned int offset;	/* bit offset of the best match */
+	unsigned int errors;	/* number of bit errors at that offset */
+};
+
+/* correlate the input against all training sequences in the mask in one
+ * pass, 64 offsets at a time.  For every sequence with a match of at most
+ * max_errors bit errors, match[type] receives the offset with the fewest
+ * errors (the earliest one on a tie).  'match' must have room for
+ * TETRA_TRAIN_EXT+1 entries.  Returns the mask of sequences found. */
+uint32_t tetra_correlate_train_seq(const uint8_t *in, unsigned int end_of_in,
+				   uint32_t mask_of_train_seq, unsigned int max_errors,
+				   struct tetra_train_seq_match *match);
+
 #endif /* TETRA_BURST_H */
@@ -20,7 +20,9 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
 #include <osmocom/core/utils.h>
 
@@ -31,134 +33,543 @@
 #include <tetra_tdma.h>
 #include <phy/tetra_burst_sync.h>
 
-struct tetra_phy_state t_phy_state;
+void tetra_burst_rx_cb(const int8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv);
+void tetra_burst_dmo_rx_cb(const int8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv);
 
-void tetra_burst_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv);
-void tetra_burst_dmo_rx_cb(const uint8_t *burst, unsigned int len, enum tetra_train_seq type, void *priv);
+#define BITBUF_MASK	(TETRA_BITBUF_SIZE-1)
 
-static void make_bitbuf_space(struct tetra_rx_state *trs, unsigned int len)
+/* pointer to the oldest bit in the ring, valid for bits_in_buf bits */
+static inline uint8_t *bitbuf_head(struct tetra_rx_state *trs)
 {
-	unsigned int bitbuf_space = sizeof(trs->bitbuf) - trs->bits_in_buf;
+	return trs->bitbuf + trs->bitbuf_rd;
+}
+
+/* same, for the soft bits of the same positions */
+static inline int8_t *sbitbuf_head(struct tetra_rx_state *trs)
+{
+	return trs->sbitbuf + trs->bitbuf_rd;
+}
+
+/* drop 'len' bits from the head of the ring */
+static void bitbuf_consume(struct tetra_rx_state *trs, unsigned int len)
+{
+	trs->bitbuf_rd = (trs->bitbuf_rd + len) & BITBUF_MASK;
+	trs->bits_in_buf -= len;
+	trs->bitbuf_start_bitnum += len;
+}
+
+/* take back the last 'len' consumed bits; they are still in the ring as
+ * long as it does not overflow with them */
+static int bitbuf_unconsume(struct tetra_rx_state *trs, unsigned int len)
+{
+	if (trs->bits_in_buf + len > TETRA_BITBUF_SIZE || trs->bitbuf_start_bitnum < len)
+		return -1;
+
+	trs->bitbuf_rd = (trs->bitbuf_rd - len) & BITBUF_MASK;
+	trs->bits_in_buf += len;
+	trs->bitbuf_start_bitnum -= len;
+	return 0;
+}
+
+/* length of the SYNC training sequence, the longest one searched for */
+#define SYNC_TRAIN_BITS		38
+
+/* Lock tracking: once locked, the training sequence of a burst is only
+ * looked for within TRACK_WINDOW bits of where it belongs, allowing for
+ * TRACK_MAX_ERRORS bit errors in it, and the burst grid follows it to
+ * correct for sample clock drift.  Only after TRACK_MAX_MISSES bursts in a
+ * row without one does the receiver fall back to a full SYNC search. */
+#define TRACK_WINDOW		4
+#define TRACK_MAX_ERRORS	2
+#define TRACK_MAX_MISSES	4
+
+/* bits of a burst the training sequences are looked for in: from the SYNC
+ * one at 214 to the end of the TMO normal one at 244 */
+#define TRACK_REGION_START	(214 - TRACK_WINDOW)
+#define TRACK_REGION_LEN	(244 + 22 + TRACK_WINDOW - TRACK_REGION_START)
+
+/* DMO slot scheduling: a DM call occupies the odd (channel A) or the even
+ * (channel B) timeslots, the DMAC-SYNC PDUs tell which.  A slot of the other
+ * channel that had no training sequence DMO_IDLE_MISSES times in a row is
+ * taken as idle and not looked at, except in frame DMO_PROBE_FN of every
+ * multiframe to notice the other channel coming up. */
+#define DMO_IDLE_MISSES		4
+#define DMO_PROBE_FN		18
+
+/* index of timeslot 'tn' (1..4, 0 from a DMAC-SYNC meaning 4) */
+static inline unsigned int slot_idx(uint32_t tn)
+{
+	return (tn + 3) & 3;
+}
+
+static int dmo_slot_idle(const struct tetra_rx_state *trs, const struct tetra_phy_state *phy,
+			 const struct tetra_tdma_time *t)
+{
+	unsigned int idx = slot_idx(t->tn);
+
+	return phy->dmo_slots && !(phy->dmo_slots & (1 << idx)) &&
+	       trs->slot_misses[idx] >= DMO_IDLE_MISSES && t->fn != DMO_PROBE_FN;
+}
+
+/* Training sequence of the burst expected to start at 'burst'.  Returns its
+ * type, with the offset it belongs at (214, 230 or 244) in *nominal and the
+ * number of bits the burst actually starts later in *drift, or -1.  The
+ * drift is always even: a match at an odd offset straddles two symbols. */
+static int track_train_seq(const uint8_t *burst, int dmo, unsigned int *nominal, int *drift)
+{
+	static const unsigned int norm_offs[2] = { 244, 230 };
+	struct tetra_train_seq_match match[TETRA_TRAIN_EXT+1];
+	enum tetra_train_seq types[3] = { TETRA_TRAIN_SYNC, TETRA_TRAIN_NORM_1, TETRA_TRAIN_NORM_2 };
+	unsigned int i, j, best_errors = 0;
+	uint32_t found;
+	int best = -1;
+
+	found = tetra_correlate_train_seq(burst + TRACK_REGION_START, TRACK_REGION_LEN,
+					  (1 << TETRA_TRAIN_SYNC)|
+					  (1 << TETRA_TRAIN_NORM_1)|
+					  (1 << TETRA_TRAIN_NORM_2), TRACK_MAX_ERRORS, match);
+
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		const struct tetra_train_seq_match *m = &match[types[i]];
+
+		if (!(found & (1 << types[i])))
+			continue;
+
+		/* normal bursts are at 244, in DMO also at 230 */
+		for (j = 0; j < (types[i] == TETRA_TRAIN_SYNC ? 1 : 1 + dmo); j++) {
+			unsigned int nom = types[i] == TETRA_TRAIN_SYNC ? 214 : norm_offs[j];
+			int d = (int) (m->offset + TRACK_REGION_START) - (int) nom;
+
+			if (d < -TRACK_WINDOW || d > TRACK_WINDOW || (d & 1))
+				continue;
+			if (best >= 0 && (m->errors > best_errors ||
+					  (m->errors == best_errors && abs(d) >= abs(*drift))))
+				continue;
+			best = types[i];
+			best_errors = m->errors;
+			*nominal = nom;
+			*drift = d;
+		}
+	}
+
+	return best;
+}
+
+/* write 'len' bits at ring index 'wr' and into its mirror.  Exactly one of
+ * 'bits' (hard) and 'sbits' (soft) is given, the other form is derived;
+ * 'sbits' may be the ring position itself. */
+static void bitbuf_write(struct tetra_rx_state *trs, unsigned int wr, const uint8_t *bits,
+			 const int8_t *sbits, unsigned int len)
+{
+	uint8_t *hard = trs->bitbuf + wr;
+	int8_t *soft = trs->sbitbuf + wr;
+	unsigned int i;
+
+	if (bits) {
+		memcpy(hard, bits, len);
+		tetra_ubits2sbits(soft, bits, len);
+	} else {
+		for (i = 0; i < len; i++) {
+			/* keep -128 out, de-scrambling negates soft bits */
+			int8_t sbit = sbits[i] == -128 ? -127 : sbits[i];
+
+			soft[i] = sbit;
+			hard[i] = tetra_sbit2ubit(sbit);
+		}
+	}
+	memcpy(hard + TETRA_BITBUF_SIZE, hard, len);
+	memcpy(soft + TETRA_BITBUF_SIZE, soft, len);
+}
+
+/* drop the oldest bits if 'len' (at most TETRA_BITBUF_SIZE) more do not
+ * fit, returns the ring index where they go */
+static unsigned int bitbuf_make_room(struct tetra_rx_state *trs, unsigned int len)
+{
+	unsigned int bitbuf_space = TETRA_BITBUF_SIZE - trs->bits_in_buf;
 
 	if (bitbuf_space < len) {
 		unsigned int delta = len - bitbuf_space;
 
-		DEBUGP("bitbuf left: %u, shrinking by %u\n", bitbuf_space, delta);
-		memmove(trs->bitbuf, trs->bitbuf + delta, trs->bits_in_buf - delta);
-		trs->bits_in_buf -= delta;
-		trs->bitbuf_start_bitnum += delta;
-		bitbuf_space = sizeof(trs->bitbuf) - trs->bits_in_buf;
+		TLOGP(TLOG_PHY, TLOGL_DEBUG, "bitbuf left: %u, shrinking by %u\n", bitbuf_space, delta);
+		bitbuf_consume(trs, delta);
 	}
+
+	return (trs->bitbuf_rd + trs->bits_in_buf) & BITBUF_MASK;
 }
 
-/* input a raw bitstream into the tetra burst synchronizaer */
-int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int len)
+/* append 'len' bits, at most TETRA_BITBUF_SIZE */
+static void bitbuf_append(struct tetra_rx_state *trs, const uint8_t *bits,
+			  const int8_t *sbits, unsigned int len)
+{
+	unsigned int wr, chunk;
+
+	wr = bitbuf_make_room(trs, len);
+	chunk = TETRA_BITBUF_SIZE - wr;
+	if (chunk > len)
+		chunk = len;
+	bitbuf_write(trs, wr, bits, sbits, chunk);
+	if (len > chunk)
+		bitbuf_write(trs, 0, bits ? bits + chunk : NULL,
+			     sbits ? sbits + chunk : NULL, len - chunk);
+	trs->bits_in_buf += len;
+}
+
+/* run the synchronizer state machine after 'len' new bits were appended,
+ * until it needs more bits: every complete burst in the ring is handed up */
+static int burst_sync_run(struct tetra_rx_state *trs, unsigned int len)
 {
 	int rc;
-	unsigned int train_seq_offs;
+	unsigned int train_seq_offs, skip;
 	struct tetra_mac_state *tms = trs->burst_cb_priv;
 
-	DEBUGP("burst_sync_in: %u bits, state %u\n", len, trs->state);
-
-	/* First: append the data to the bitbuf */
-	make_bitbuf_space(trs, len);
-	memcpy(trs->bitbuf + trs->bits_in_buf, bits, len);
-	trs->bits_in_buf += len;
+	TLOGP(TLOG_PHY, TLOGL_DEBUG, "burst_sync_in: %u bits, state %u\n", len, trs->state);
 
-	switch (trs->state) {
-	case RX_S_UNLOCKED:
-		if (trs->bits_in_buf < TETRA_BITS_PER_TS*2) {
-			/* wait for more bits to arrive */
-			DEBUGP("-> waiting for more bits to arrive\n");
-			return len;
-		}
-		DEBUGP("-> trying to find training sequence between bit %u and %u\n",
-			trs->bitbuf_start_bitnum, trs->bits_in_buf);
-		rc = tetra_find_train_seq(trs->bitbuf, trs->bits_in_buf,
-					  (1 << TETRA_TRAIN_SYNC), &train_seq_offs);
-		if (rc < 0)
-			return rc;
-		printf("found SYNC training sequence in bit #%u\n", train_seq_offs);
-		trs->state = RX_S_KNOW_FSTART;
-		trs->next_frame_start_bitnum = trs->bitbuf_start_bitnum + train_seq_offs + 296;
-#if 0
-		if (train_seq_offs < 214) {
-			/* not enough leading bits for start of burst */
-			/* we just drop everything that we received so far */
-			trs->bitbuf_start_bitnum += trs->bits_in_buf;
-			trs->bits_in_buf = 0;
-		}
-#endif
-		break;
-	case RX_S_KNOW_FSTART:
-		/* we are locked, i.e. already know when the next frame should start */
-		if (trs->bitbuf_start_bitnum + trs->bits_in_buf < trs->next_frame_start_bitnum)
-			return 0;
-		else {
-			/* shift start of frame to start of bitbuf */
-			int offset = trs->next_frame_start_bitnum - trs->bitbuf_start_bitnum;
-			int bits_remaining = trs->bits_in_buf - offset;
-
-			memmove(trs->bitbuf, trs->bitbuf+offset, bits_remaining);
-			trs->bits_in_buf = bits_remaining;
-			trs->bitbuf_start_bitnum += offset;
-
-			trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
-			trs->state = RX_S_LOCKED;
-		}
-	case RX_S_LOCKED:
-		if (trs->bits_in_buf < TETRA_BITS_PER_TS) {
-			/* not sufficient data for the full frame yet */
-			return len;
-		} else {
-			/* we have successfully received (at least) one frame */
-			tetra_tdma_time_add_tn(&t_phy_state.time, 1);
-			printf("\nBURST");
-			DEBUGP(": %s", osmo_ubit_dump(trs->bitbuf, TETRA_BITS_PER_TS));
-			printf("\n");
-			rc = tetra_find_train_seq(trs->bitbuf, trs->bits_in_buf,
-						  (1 << TETRA_TRAIN_NORM_1)|
-						  (1 << TETRA_TRAIN_NORM_2)|
+	while (1) {
+		switch (trs->state) {
+		case RX_S_UNLOCKED:
+			if (trs->bits_in_buf < TETRA_BITS_PER_TS*2) {
+				/* wait for more bits to arrive */
+				TLOGP(TLOG_PHY, TLOGL_DEBUG, "-> waiting for more bits to arrive\n");
+				return len;
+			}
+			TLOGP(TLOG_PHY, TLOGL_DEBUG, "-> trying to find training sequence between bit %u and %u\n",
+				trs->bitbuf_start_bitnum, trs->bits_in_buf);
+			/* the bits up to search_bitnum had no SYNC training sequence
+			 * starting in them, only the new ones need to be searched */
+			skip = 0;
+			if (trs->search_bitnum > trs->bitbuf_start_bitnum)
+				skip = trs->search_bitnum - trs->bitbuf_start_bitnum;
+			rc = tetra_find_train_seq(bitbuf_head(trs) + skip, trs->bits_in_buf - skip,
 						  (1 << TETRA_TRAIN_SYNC), &train_seq_offs);
-			switch (rc) {
-			case TETRA_TRAIN_SYNC:
-				if (train_seq_offs == 214)
-					if (tms->infra_mode == TETRA_INFRA_DMO) {
-						tetra_burst_dmo_rx_cb(trs->bitbuf, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
-					} else {
-						tetra_burst_rx_cb(trs->bitbuf, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+			if (rc < 0) {
+				/* a sequence may start in the last bits and end in new ones */
+				trs->search_bitnum = trs->bitbuf_start_bitnum + trs->bits_in_buf -
+						     (SYNC_TRAIN_BITS - 1);
+				return rc;
+			}
+			train_seq_offs += skip;
+			TLOGP(TLOG_PHY, TLOGL_INFO, "found SYNC training sequence in bit #%u\n", train_seq_offs);
+			trs->state = RX_S_KNOW_FSTART;
+			trs->track_misses = 0;
+			memset(trs->slot_misses, 0, sizeof(trs->slot_misses));
+			trs->next_frame_start_bitnum = trs->bitbuf_start_bitnum + train_seq_offs + 296;
+			break;
+		case RX_S_KNOW_FSTART:
+			/* we are locked, i.e. already know when the next frame should start */
+			if (trs->bitbuf_start_bitnum + trs->bits_in_buf < trs->next_frame_start_bitnum)
+				return 0;
+			else {
+				/* advance the ring to the start of frame */
+				bitbuf_consume(trs, trs->next_frame_start_bitnum - trs->bitbuf_start_bitnum);
+
+				trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
+				trs->state = RX_S_LOCKED;
+			}
+		case RX_S_LOCKED:
+			if (trs->bits_in_buf < TETRA_BITS_PER_TS) {
+				/* not sufficient data for the full frame yet */
+				return len;
+			} else {
+				/* we have successfully received (at least) one frame,
+				 * which is handed up in place from the ring */
+				int dmo = tms->infra_mode == TETRA_INFRA_DMO;
+				struct tetra_tdma_time t = tms->phy_state.time;
+				const uint8_t *burst;
+				const int8_t *sburst;
+				unsigned int slot;
+				int drift;
+
+				tetra_tdma_time_add_tn(&t, 1);
+				slot = slot_idx(t.tn);
+				if (dmo && dmo_slot_idle(trs, &tms->phy_state, &t)) {
+					TLOGP(TLOG_PHY, TLOGL_DEBUG, "skipping idle DMO slot %u\n", slot + 1);
+					tms->phy_state.time = t;
+					bitbuf_consume(trs, TETRA_BITS_PER_TS);
+					trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
+					break;
+				}
+
+				rc = track_train_seq(bitbuf_head(trs), dmo, &train_seq_offs, &drift);
+				if (rc >= 0 && drift) {
+					/* move the burst grid along with the sample clock */
+					if (drift > 0)
+						bitbuf_consume(trs, drift);
+					else if (bitbuf_unconsume(trs, -drift) < 0)
+						rc = -1;
+					if (rc >= 0) {
+						TLOGP(TLOG_PHY, TLOGL_INFO, "burst timing drifted by %d bits\n", drift);
+						trs->next_frame_start_bitnum += drift;
+						if (trs->bits_in_buf < TETRA_BITS_PER_TS)
+							return len;
 					}
-				else {
-					fprintf(stderr, "#### TRAIN_SYNC #### SYNC burst at offset %u?!?\n", train_seq_offs);
-					trs->state = RX_S_UNLOCKED;
 				}
-				break;
-			case TETRA_TRAIN_NORM_1:
-			case TETRA_TRAIN_NORM_2:
-			case TETRA_TRAIN_NORM_3:
-				/* DMO 396-2 - 9.4.3.2.1 DM Normal Burst (DNB)*/
-				if (train_seq_offs == 230 && tms->infra_mode == TETRA_INFRA_DMO) {
-					tetra_burst_dmo_rx_cb(trs->bitbuf, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+				burst = bitbuf_head(trs);
+				sburst = sbitbuf_head(trs);
+
+				tetra_tdma_time_add_tn(&tms->phy_state.time, 1);
+				TLOGP(TLOG_PHY, TLOGL_INFO, "\nBURST");
+				TLOGP(TLOG_PHY, TLOGL_DEBUG, ": %s", osmo_ubit_dump(burst, TETRA_BITS_PER_TS));
+				TLOGP(TLOG_PHY, TLOGL_INFO, "\n");
+				if (rc >= 0)
+					trs->slot_misses[slot] = 0;
+				else if (trs->slot_misses[slot] < UINT8_MAX)
+					trs->slot_misses[slot]++;
+
+				switch (rc) {
+				case TETRA_TRAIN_SYNC:
+					trs->track_misses = 0;
+					if (dmo)
+						tetra_burst_dmo_rx_cb(sburst, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+					else
+						tetra_burst_rx_cb(sburst, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+					break;
+				case TETRA_TRAIN_NORM_1:
+				case TETRA_TRAIN_NORM_2:
+					trs->track_misses = 0;
+					/* DMO 396-2 - 9.4.3.2.1 DM Normal Burst (DNB)*/
+					if (train_seq_offs == 230)
+						tetra_burst_dmo_rx_cb(sburst, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+					else
+						tetra_burst_rx_cb(sburst, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
+					break;
+				default:
+					/* the other DM channel may well be silent */
+					if (dmo && tms->phy_state.dmo_slots &&
+					    !(tms->phy_state.dmo_slots & (1 << slot)))
+						break;
+					/* keep going on the burst grid for a few bursts */
+					if (++trs->track_misses < TRACK_MAX_MISSES) {
+						TLOGP(TLOG_PHY, TLOGL_INFO, "no training sequence in burst (%u in a row)\n",
+						      trs->track_misses);
+						break;
+					}
+					TLOGP(TLOG_PHY, TLOGL_NOTICE, "#### could not find successive burst training sequence\n");
+					trs->state = RX_S_UNLOCKED;
+					tms->phy_state.dmo_slots = 0;
+					break;
 				}
-				else if (train_seq_offs == 244)
-					tetra_burst_rx_cb(trs->bitbuf, TETRA_BITS_PER_TS, rc, trs->burst_cb_priv);
-				else
-					fprintf(stderr, "### TRAIN_NORM #### SYNC burst at offset %u?!?\n", train_seq_offs);
-				break;
-			default:
-				fprintf(stderr, "#### could not find successive burst training sequence\n");
-				trs->state = RX_S_UNLOCKED;
-				break;
+
+				/* release the burst from the ring */
+				bitbuf_consume(trs, TETRA_BITS_PER_TS);
+				trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
 			}
+			break;
 
-			/* move remainder to start of buffer */
-			trs->bits_in_buf -= TETRA_BITS_PER_TS;
-			memmove(trs->bitbuf, trs->bitbuf+TETRA_BITS_PER_TS, trs->bits_in_buf);
-			trs->bitbuf_start_bitnum += TETRA_BITS_PER_TS;
-			trs->next_frame_start_bitnum += TETRA_BITS_PER_TS;
 		}
-		break;
+	}
+}
+
+/* Bits appended to the ring at a time.  Once locked, burst_sync_run()
+ * leaves less than a burst in it, so no unprocessed bit is dropped. */
+#define SYNC_IN_MAX	(TETRA_BITBUF_SIZE - TETRA_BITS_PER_TS)
+
+int8_t *tetra_burst_sync_reserve_soft(struct tetra_rx_state *trs, unsigned int len)
+{
+	if (len > SYNC_IN_MAX)
+		return NULL;
+
+	/* the window may run past the end of the ring into the mirror,
+	 * tetra_burst_sync_commit_soft() moves that part to the start */
+	return trs->sbitbuf + bitbuf_make_room(trs, len);
+}
+
+int tetra_burst_sync_commit_soft(struct tetra_rx_state *trs, unsigned int len)
+{
+	unsigned int wr = (trs->bitbuf_rd + trs->bits_in_buf) & BITBUF_MASK;
+	unsigned int chunk = TETRA_BITBUF_SIZE - wr;
+
+	if (chunk > len)
+		chunk = len;
+	if (len > chunk)
+		memcpy(trs->sbitbuf, trs->sbitbuf + TETRA_BITBUF_SIZE, len - chunk);
+
+	/* in place: clamps the soft bits, derives the hard ones, mirrors */
+	bitbuf_write(trs, wr, NULL, trs->sbitbuf + wr, chunk);
+	if (len > chunk)
+		bitbuf_write(trs, 0, NULL, trs->sbitbuf, len - chunk);
+	trs->bits_in_buf += len;
+
+	return burst_sync_run(trs, len);
+}
+
+/* input a raw bitstream into the tetra burst synchronizaer */
+int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int len)
+{
+	int rc = 0;
+
+	while (len) {
+		unsigned int chunk = len > SYNC_IN_MAX ? SYNC_IN_MAX : len;
+
+		bitbuf_append(trs, bits, NULL, chunk);
+		rc = burst_sync_run(trs, chunk);
+		bits += chunk;
+		len -= chunk;
+	}
+
+	return rc;
+}
+
+int tetra_burst_sync_in_soft(struct tetra_rx_state *trs, const int8_t *sbits, unsigned int len)
+{
+	int rc = 0;
+
+	while (len) {
+		unsigned int chunk = len > SYNC_IN_MAX ? SYNC_IN_MAX : len;
+
+		bitbuf_append(trs, NULL, sbits, chunk);
+		rc = burst_sync_run(trs, chunk);
+		sbits += chunk;
+		len -= chunk;
+	}
+
+	return rc;
+}
+
+/* number of bursts handed to tetra_burst_rx_batch() at once */
+#define MEM_BATCH_BURSTS	32
+
+/* the SYNC search looks at this many bits at a time */
+#define MEM_SEARCH_BITS		4096
+
+/* copy 'len' bits at 'pos' of a recording in memory out as hard bits and,
+ * if 'soft' is given, as soft bits */
+static void mem_fetch(const uint8_t *bits, const int8_t *sbits, size_t pos, unsigned int len,
+		      uint8_t *hard, int8_t *soft)
+{
+	unsigned int i;
 
+	if (bits) {
+		memcpy(hard, bits + pos, len);
+		if (soft)
+			tetra_ubits2sbits(soft, bits + pos, len);
+		return;
 	}
-	return len;
+
+	for (i = 0; i < len; i++) {
+		/* keep -128 out, de-scrambling negates soft bits */
+		int8_t sbit = sbits[pos + i] == -128 ? -127 : sbits[pos + i];
+
+		if (soft)
+			soft[i] = sbit;
+		hard[i] = tetra_sbit2ubit(sbit);
+	}
+}
+
+/* training sequence of the burst starting at 'burst' if it is at the
+ * offset it belongs to, as checked by burst_sync_run(), else -1 */
+static int mem_burst_type(const uint8_t *burst, int dmo)
+{
+	unsigned int offs;
+	int rc;
+
+	rc = tetra_find_train_seq(burst, TETRA_BITS_PER_TS,
+				  (1 << TETRA_TRAIN_NORM_1)|
+				  (1 << TETRA_TRAIN_NORM_2)|
+				  (1 << TETRA_TRAIN_SYNC), &offs);
+	switch (rc) {
+	case TETRA_TRAIN_SYNC:
+		return offs == 214 ? rc : -1;
+	case TETRA_TRAIN_NORM_1:
+	case TETRA_TRAIN_NORM_2:
+		return (offs == 244 || (dmo && offs == 230)) ? rc : -1;
+	default:
+		return -1;
+	}
+}
+
+ssize_t tetra_burst_sync_mem_find(const uint8_t *bits, const int8_t *sbits, size_t len,
+				  size_t from, int dmo)
+{
+	uint8_t hard[MEM_SEARCH_BITS];
+	uint8_t next[TETRA_BITS_PER_TS];
+	size_t pos = from;
+
+	while (pos + SYNC_TRAIN_BITS <= len) {
+		unsigned int chunk = MEM_SEARCH_BITS, offs;
+		size_t start;
+
+		if (chunk > len - pos)
+			chunk = len - pos;
+		mem_fetch(bits, sbits, pos, chunk, hard, NULL);
+		if (tetra_find_train_seq(hard, chunk, (1 << TETRA_TRAIN_SYNC), &offs) < 0) {
+			/* a sequence may straddle the end of the chunk */
+			pos += chunk - SYNC_TRAIN_BITS + 1;
+			continue;
+		}
+
+		/* accept it if there is a whole burst around it and the
+		 * next burst has its training sequence in place as well */
+		start = pos + offs - 214;
+		if (pos + offs >= 214 && start >= from && start + 2*TETRA_BITS_PER_TS <= len) {
+			mem_fetch(bits, sbits, start + TETRA_BITS_PER_TS, TETRA_BITS_PER_TS, next, NULL);
+			if (mem_burst_type(next, dmo) >= 0)
+				return start;
+		}
+		pos += offs + 1;
+	}
+
+	return -1;
+}
+
+long tetra_burst_sync_mem(struct tetra_mac_state *tms, const uint8_t *bits, const int8_t *sbits,
+			  size_t start_bit, size_t len)
+{
+	uint8_t hard[MEM_BATCH_BURSTS * TETRA_BITS_PER_TS];
+	int8_t soft[MEM_BATCH_BURSTS * TETRA_BITS_PER_TS];
+	enum tetra_train_seq types[MEM_BATCH_BURSTS];
+	int dmo = tms->infra_mode == TETRA_INFRA_DMO;
+	long num_bursts = 0;
+	unsigned int misses;
+	ssize_t start;
+	size_t pos = start_bit;
+
+	while ((start = tetra_burst_sync_mem_find(bits, sbits, len, pos, dmo)) >= 0) {
+		TLOGP(TLOG_PHY, TLOGL_INFO, "found SYNC training sequence in bit #%zu\n", start + 214);
+		pos = start;
+		misses = 0;
+
+		/* locked: hand up runs of bursts up to one that lacks its
+		 * training sequence or has moved */
+		while (1) {
+			unsigned int n = (len - pos) / TETRA_BITS_PER_TS, i, nominal;
+			int rc = 0, drift = 0;
+
+			if (n > MEM_BATCH_BURSTS)
+				n = MEM_BATCH_BURSTS;
+			if (!n)
+				return num_bursts;
+
+			mem_fetch(bits, sbits, pos, n * TETRA_BITS_PER_TS, hard, soft);
+			for (i = 0; i < n; i++) {
+				rc = track_train_seq(hard + i * TETRA_BITS_PER_TS, dmo, &nominal, &drift);
+				if (rc < 0 || drift)
+					break;
+				types[i] = rc;
+				misses = 0;
+			}
+			if (i)
+				tetra_burst_rx_batch(soft, types, i, tms);
+			pos += i * TETRA_BITS_PER_TS;
+			num_bursts += i;
+
+			if (rc >= 0 && drift) {
+				/* fetch again from where the burst really starts */
+				TLOGP(TLOG_PHY, TLOGL_INFO, "burst timing drifted by %d bits\n", drift);
+				pos += drift;
+				continue;
+			}
+			if (rc < 0) {
+				if (++misses >= TRACK_MAX_MISSES) {
+					TLOGP(TLOG_PHY, TLOGL_NOTICE, "#### could not find successive burst training sequence\n");
+					break;
+				}
+				/* skip the burst, staying on the grid */
+				TLOGP(TLOG_PHY, TLOGL_INFO, "no training sequence in burst (%u in a row)\n", misses);
+				tetra_tdma_time_add_tn(&tms->phy_state.time, 1);
+				pos += TETRA_BITS_PER_TS;
+			}
+		}
+	}
+
+	return num_bursts;
 }
@@ -2,6 +2,9 @@
 #define TETRA_BURST_SYNC_H
 
 #include <stdint.h>
+#include <sys/types.h>
+
+struct tetra_mac_state;
 
 enum rx_state {
 	RX_S_UNLOCKED,		/* we're completely unlocked */
@@ -9,18 +12,59 @@ enum rx_state {
 	RX_S_LOCKED,		/* fully locked */
 };
 
+/* size of the bit ring buffer, must be a power of two */
+#define TETRA_BITBUF_SIZE	4096
+
 struct tetra_rx_state {
 	enum rx_state state;
 	unsigned int bits_in_buf;		/* how many bits are currently in bitbuf */
-	uint8_t bitbuf[4096];
+	unsigned int bitbuf_rd;			/* ring index of the first bit in bitbuf */
+	/* every bit is stored twice (at n and n+TETRA_BITBUF_SIZE), so any
+	 * window of up to TETRA_BITBUF_SIZE bits starting at bitbuf_rd can be
+	 * handed out as one contiguous span without moving the buffer */
+	uint8_t bitbuf[2*TETRA_BITBUF_SIZE];
+	/* soft bits (int8_t LLRs) for the same positions as bitbuf; the
+	 * training sequence search runs on bitbuf, the bursts are handed
+	 * up from here */
+	int8_t sbitbuf[2*TETRA_BITBUF_SIZE];
 	unsigned int bitbuf_start_bitnum;	/* bit number at first element in bitbuf */
 	unsigned int next_frame_start_bitnum;	/* frame start expected at this bitnum */
+	unsigned int track_misses;		/* bursts in a row without training sequence */
+	unsigned int search_bitnum;		/* SYNC search resumes here when unlocked */
+	uint8_t slot_misses[4];			/* DMO: the same, per timeslot */
 
-	void *burst_cb_priv;
+	void *burst_cb_priv;			/* struct tetra_mac_state of this receiver */
 };
 
 
-/* input a raw bitstream into the tetra burst synchronizaer */
+/* input a raw bitstream of any length into the tetra burst synchronizaer,
+ * every burst completed by it is handed up before returning */
 int tetra_burst_sync_in(struct tetra_rx_state *trs, uint8_t *bits, unsigned int len);
 
+/* input soft bits (+127 = 0, -127 = 1, 0 = erasure) into the synchronizer */
+int tetra_burst_sync_in_soft(struct tetra_rx_state *trs, const int8_t *sbits, unsigned int len);
+
+/* Zero-copy soft bit input: returns room for up to 'len' soft bits at the
+ * tail of the bit ring, or NULL if 'len' exceeds TETRA_BITBUF_SIZE minus
+ * one burst.  The caller writes the bits there and passes them to the
+ * synchronizer with tetra_burst_sync_commit_soft(), which is then the same
+ * as tetra_burst_sync_in_soft() without copying them in. */
+int8_t *tetra_burst_sync_reserve_soft(struct tetra_rx_state *trs, unsigned int len);
+int tetra_burst_sync_commit_soft(struct tetra_rx_state *trs, unsigned int len);
+
+/* Find the first burst at or after bit 'from' of a recording held in memory
+ * that carries a SYNC training sequence and is followed by another burst.
+ * The recording is given either as hard bits or as soft bits, one per
+ * byte, the other pointer is NULL.  Returns its first bit or -1. */
+ssize_t tetra_burst_sync_mem_find(const uint8_t *bits, const int8_t *sbits, size_t len,
+				  size_t from, int dmo);
+
+/* Decode the bits from 'start_bit' up to 'len' of a recording held in
+ * memory; bit numbers in the log count from its beginning.  Unlike with
+ * the streaming input, the SYNC burst the lock is gained on is decoded as
+ * well, and the bursts go up through tetra_burst_rx_batch().  Returns the
+ * number of bursts decoded. */
+long tetra_burst_sync_mem(struct tetra_mac_state *tms, const uint8_t *bits, const int8_t *sbits,
+			  size_t start_bit, size_t len);
+
 #endif /* TETRA_BURST_SYNC_H */
@@ -0,0 +1,197 @@
+/* Polyphase FFT filterbank splitting wideband baseband into 25 kHz channels
+ *
+ * Channel c is the input mixed down by c * fs / M, low-pass filtered and
+ * decimated by D = M / 2.  Splitting the prototype filter into M branches,
+ * this becomes M short filters plus one M point FFT per output sample of
+ * all channels, and a sign flip, as D * c / M is a multiple of 1/2.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <osmocom/core/talloc.h>
+
+#include <phy/tetra_channelizer.h>
+
+/* prototype filter taps per branch */
+#define PROTO_TAPS_PER_BRANCH	16
+
+/* cut-off of the prototype filter relative to the channel spacing; a
+ * TETRA signal reaches 12.15 kHz from the center */
+#define PROTO_CUTOFF		0.66
+
+struct tetra_channelizer {
+	unsigned int num_chans;		/* M, a power of two */
+	unsigned int len;		/* prototype filter length, M * taps per branch */
+	float *proto;
+
+	/* input delay line, newest sample first from hist_pos; stored
+	 * twice (at n and n+len) to always have one contiguous window */
+	float *hist_i, *hist_q;
+	unsigned int hist_pos;
+	unsigned int fill;		/* input samples since the last output */
+	unsigned int odd;		/* the next output sample has an odd index */
+
+	/* branch filter outputs, then the FFT of them */
+	float *v_i, *v_q;
+
+	uint16_t *bitrev;
+	float *tw_i, *tw_q;		/* exp(2*pi*j * k / M) for k < M/2 */
+};
+
+struct tetra_channelizer *tetra_channelizer_alloc(void *ctx, unsigned int num_chans)
+{
+	struct tetra_channelizer *tc;
+	unsigned int i, j, bits = 0;
+	double fc, sum = 0;
+
+	if (num_chans < 4 || num_chans > 4096 || (num_chans & (num_chans - 1)))
+		return NULL;
+	while ((1U << bits) < num_chans)
+		bits++;
+
+	tc = talloc_zero(ctx, struct tetra_channelizer);
+	if (!tc)
+		return NULL;
+	tc->num_chans = num_chans;
+	tc->len = num_chans * PROTO_TAPS_PER_BRANCH;
+	tc->proto = talloc_zero_array(tc, float, tc->len);
+	tc->hist_i = talloc_zero_array(tc, float, 2 * tc->len);
+	tc->hist_q = talloc_zero_array(tc, float, 2 * tc->len);
+	tc->v_i = talloc_zero_array(tc, float, num_chans);
+	tc->v_q = talloc_zero_array(tc, float, num_chans);
+	tc->bitrev = talloc_zero_array(tc, uint16_t, num_chans);
+	tc->tw_i = talloc_zero_array(tc, float, num_chans / 2);
+	tc->tw_q = talloc_zero_array(tc, float, num_chans / 2);
+
+	/* Blackman windowed sinc, unity gain at DC */
+	fc = PROTO_CUTOFF / num_chans;
+	for (i = 0; i < tc->len; i++) {
+		double t = i - (tc->len - 1) / 2.0;
+		double w = 0.42 - 0.5 * cos(2*M_PI*i / (tc->len - 1)) +
+			   0.08 * cos(4*M_PI*i / (tc->len - 1));
+		double h = fabs(t) < 1e-9 ? 2*fc : sin(2*M_PI*fc*t) / (M_PI*t);
+
+		tc->proto[i] = h * w;
+		sum += tc->proto[i];
+	}
+	for (i = 0; i < tc->len; i++)
+		tc->proto[i] /= sum;
+
+	for (i = 0; i < num_chans; i++) {
+		unsigned int r = 0;
+
+		for (j = 0; j < bits; j++)
+			r |= ((i >> j) & 1) << (bits - 1 - j);
+		tc->bitrev[i] = r;
+	}
+	for (i = 0; i < num_chans / 2; i++) {
+		tc->tw_i[i] = cos(2*M_PI*i / num_chans);
+		tc->tw_q[i] = sin(2*M_PI*i / num_chans);
+	}
+
+	return tc;
+}
+
+/* in-place radix-2 FFT with positive exponent: X[c] = sum x[k] e^(2 pi j ck/M) */
+static void fft_inverse(const struct tetra_channelizer *tc, float *re, float *im)
+{
+	unsigned int M = tc->num_chans;
+	unsigned int i, k, len;
+
+	for (i = 0; i < M; i++) {
+		unsigned int j = tc->bitrev[i];
+
+		if (i < j) {
+			float t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (len = 2; len <= M; len <<= 1) {
+		unsigned int half = len / 2, step = M / len;
+
+		for (i = 0; i < M; i += len) {
+			for (k = 0; k < half; k++) {
+				unsigned int a = i + k, b = a + half;
+				float wr = tc->tw_i[k * step], wi = tc->tw_q[k * step];
+				float tr = re[b] * wr - im[b] * wi;
+				float ti = re[b] * wi + im[b] * wr;
+
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/* one output sample of every channel from the current window */
+static void channelizer_output(struct tetra_channelizer *tc, float *out, unsigned int max_out,
+			       unsigned int idx)
+{
+	const float *xi = tc->hist_i + tc->hist_pos, *xq = tc->hist_q + tc->hist_pos;
+	unsigned int M = tc->num_chans;
+	unsigned int m, k, c;
+
+	/* branch k filters the input samples k, k + M, k + 2M, ... back
+	 * with the prototype taps of the same indices */
+	memset(tc->v_i, 0, M * sizeof(float));
+	memset(tc->v_q, 0, M * sizeof(float));
+	for (m = 0; m < tc->len; m += M) {
+		const float *h = tc->proto + m;
+
+		for (k = 0; k < M; k++) {
+			tc->v_i[k] += h[k] * xi[m + k];
+			tc->v_q[k] += h[k] * xq[m + k];
+		}
+	}
+
+	fft_inverse(tc, tc->v_i, tc->v_q);
+
+	/* the mixer phase at odd output samples is pi for odd channels */
+	for (c = 0; c < M; c++) {
+		float sign = (tc->odd && (c & 1)) ? -1 : 1;
+
+		out[2 * (c * max_out + idx)] = sign * tc->v_i[c];
+		out[2 * (c * max_out + idx) + 1] = sign * tc->v_q[c];
+	}
+	tc->odd ^= 1;
+}
+
+unsigned int tetra_channelizer_run(struct tetra_channelizer *tc, const float *iq, unsigned int n,
+				   float *out, unsigned int max_out)
+{
+	unsigned int i, nout = 0;
+
+	for (i = 0; i < n; i++) {
+		tc->hist_pos = tc->hist_pos ? tc->hist_pos - 1 : tc->len - 1;
+		tc->hist_i[tc->hist_pos] = tc->hist_i[tc->hist_pos + tc->len] = iq[2*i];
+		tc->hist_q[tc->hist_pos] = tc->hist_q[tc->hist_pos + tc->len] = iq[2*i+1];
+
+		if (++tc->fill < tc->num_chans / 2)
+			continue;
+		tc->fill = 0;
+		if (nout < max_out)
+			channelizer_output(tc, out, max_out, nout++);
+	}
+
+	return nout;
+}
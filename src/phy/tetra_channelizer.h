@@ -0,0 +1,30 @@
+#ifndef TETRA_CHANNELIZER_H
+#define TETRA_CHANNELIZER_H
+/* Polyphase FFT filterbank splitting wideband baseband into 25 kHz channels */
+
+#include <stdint.h>
+
+#define TETRA_CHAN_SPACING	25000
+
+/* Every channel comes out at twice the channel spacing, so a signal
+ * reaching into the transition band of the filter is not aliased onto
+ * itself */
+#define TETRA_CHAN_OUT_RATE	(2*TETRA_CHAN_SPACING)
+
+struct tetra_channelizer;
+
+/* Set up a filterbank for a sample rate of num_chans * TETRA_CHAN_SPACING.
+ * num_chans must be a power of two from 4 up to 4096.  Channel c is
+ * centered at c * TETRA_CHAN_SPACING above the center of the input, the
+ * upper half of the channels are the ones below it. */
+struct tetra_channelizer *tetra_channelizer_alloc(void *ctx, unsigned int num_chans);
+
+/* Filter 'n' complex input samples (interleaved float I/Q).  For every
+ * num_chans / 2 of them, every channel gets one complex sample, written
+ * to out + 2 * (c * max_out + i) for channel c; max_out must be at least
+ * n / (num_chans / 2) + 1.  Returns the number of output samples per
+ * channel. */
+unsigned int tetra_channelizer_run(struct tetra_channelizer *tc, const float *iq, unsigned int n,
+				   float *out, unsigned int max_out);
+
+#endif /* TETRA_CHANNELIZER_H */
@@ -0,0 +1,255 @@
+/* pi/4-DQPSK demodulator from complex baseband to soft bits
+ *
+ * Frequency correction, root raised cosine matched filter, Gardner symbol
+ * timing recovery with cubic interpolation and differential detection;
+ * the same chain as the cqpsk.py GNU Radio flow graph, run in-process.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include <phy/tetra_demod.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/* roll-off of the TETRA transmit filter */
+#define RRC_ALPHA	0.35
+
+/* the timing loop may pull the symbol period this far off nominal */
+#define OMEGA_LIMIT	0.05f
+
+/* averaging of the symbol power */
+#define POWER_ALPHA	0.01f
+
+/* soft bit value of a differential phasor component of 1/sqrt(2) times
+ * the symbol power, i.e. of an undisturbed symbol */
+#define SOFT_SCALE	90.0f
+
+#define HIST_MASK	(TETRA_DEMOD_HIST-1)
+
+/* root raised cosine impulse response at t symbol periods */
+static double rrc(double t)
+{
+	double a = RRC_ALPHA;
+
+	if (fabs(t) < 1e-9)
+		return 1.0 - a + 4*a/M_PI;
+	if (fabs(fabs(4*a*t) - 1.0) < 1e-9)
+		return a/sqrt(2) * ((1 + 2/M_PI) * sin(M_PI/(4*a)) +
+				    (1 - 2/M_PI) * cos(M_PI/(4*a)));
+
+	return (sin(M_PI*t*(1-a)) + 4*a*t*cos(M_PI*t*(1+a))) /
+	       (M_PI*t*(1 - (4*a*t)*(4*a*t)));
+}
+
+int tetra_demod_init_rate(struct tetra_demod *d, unsigned int sample_rate)
+{
+	double sps = (double) sample_rate / TETRA_SYM_RATE;
+	double sum = 0;
+	unsigned int i;
+
+	if (sps < 2 || sps > TETRA_DEMOD_MAX_SPS)
+		return -EINVAL;
+
+	memset(d, 0, sizeof(*d));
+	d->sps = sps;
+	d->ntaps = (unsigned int) (11*sps) | 1;
+
+	for (i = 0; i < d->ntaps; i++) {
+		d->taps[i] = rrc(((double) i - (d->ntaps - 1) / 2) / sps);
+		sum += d->taps[i];
+	}
+	/* unity gain at DC */
+	for (i = 0; i < d->ntaps; i++)
+		d->taps[i] /= sum;
+
+	d->rot_i = 1;
+	d->step_i = 1;
+	d->omega = sps;
+	d->t_next = sps;
+	d->power = 1;
+
+	/* loop gains in the range cqpsk.py uses; the timing ones are in
+	 * symbol periods and scaled to samples where they are applied */
+	d->gain_mu = 0.05f;
+	d->gain_omega = 0.25f * d->gain_mu * d->gain_mu;
+	d->gain_freq = 0.03f;
+
+	return 0;
+}
+
+int tetra_demod_init(struct tetra_demod *d, unsigned int sps)
+{
+	return tetra_demod_init_rate(d, sps * TETRA_SYM_RATE);
+}
+
+/* the matched filter over the current window of the delay line */
+static void mf_dot(const struct tetra_demod *d, float *yi, float *yq)
+{
+	const float *xi = d->in_i + d->in_pos, *xq = d->in_q + d->in_pos;
+	unsigned int i = 0, n = d->ntaps;
+	float si = 0, sq = 0;
+
+#if defined(__SSE__)
+	__m128 ai = _mm_setzero_ps(), aq = _mm_setzero_ps();
+	float vi[4], vq[4];
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 h = _mm_load_ps(d->taps + i);
+
+		ai = _mm_add_ps(ai, _mm_mul_ps(_mm_loadu_ps(xi + i), h));
+		aq = _mm_add_ps(aq, _mm_mul_ps(_mm_loadu_ps(xq + i), h));
+	}
+	_mm_storeu_ps(vi, ai);
+	_mm_storeu_ps(vq, aq);
+	si = vi[0] + vi[1] + vi[2] + vi[3];
+	sq = vq[0] + vq[1] + vq[2] + vq[3];
+#endif
+	for (; i < n; i++) {
+		si += xi[i] * d->taps[i];
+		sq += xq[i] * d->taps[i];
+	}
+
+	*yi = si;
+	*yq = sq;
+}
+
+/* Matched filter output 'delay' samples before the newest one, by cubic
+ * Lagrange interpolation; 'delay' must be at least 2 */
+static void interp(const struct tetra_demod *d, float delay, float *yi, float *yq)
+{
+	float pos = -delay;
+	int k = floorf(pos);
+	float f = pos - k;
+	float c[4];
+	unsigned int i, idx = d->y_pos + k - 2;
+
+	c[0] = -f * (f - 1) * (f - 2) / 6;
+	c[1] = (f + 1) * (f - 1) * (f - 2) / 2;
+	c[2] = -(f + 1) * f * (f - 2) / 2;
+	c[3] = (f + 1) * f * (f - 1) / 6;
+
+	*yi = *yq = 0;
+	for (i = 0; i < 4; i++) {
+		*yi += c[i] * d->y_i[(idx + i) & HIST_MASK];
+		*yq += c[i] * d->y_q[(idx + i) & HIST_MASK];
+	}
+}
+
+static int8_t clip_sbit(float v)
+{
+	if (v > 127)
+		return 127;
+	if (v < -127)
+		return -127;
+	return v;
+}
+
+/* one symbol at 'delay' samples before the newest matched filter output */
+static void demod_symbol(struct tetra_demod *d, float delay, int8_t *out)
+{
+	float si, sq, mi, mq, di, dq, d2i, d2q, d4i, d4q;
+	float err, ferr, norm;
+
+	interp(d, delay, &si, &sq);
+	interp(d, delay + d->omega / 2, &mi, &mq);
+
+	d->power += POWER_ALPHA * (si*si + sq*sq - d->power);
+	if (d->power < 1e-20f)
+		d->power = 1e-20f;
+
+	/* Gardner timing error, negative when sampling late */
+	err = ((d->prev_i - si) * mi + (d->prev_q - sq) * mq) / d->power;
+	if (err > 1)
+		err = 1;
+	else if (err < -1)
+		err = -1;
+	d->omega += d->gain_omega * d->sps * err;
+	if (d->omega > d->sps * (1 + OMEGA_LIMIT))
+		d->omega = d->sps * (1 + OMEGA_LIMIT);
+	else if (d->omega < d->sps * (1 - OMEGA_LIMIT))
+		d->omega = d->sps * (1 - OMEGA_LIMIT);
+	d->t_next += d->omega + d->gain_mu * d->sps * err;
+
+	/* differential detection: the phase step is +-pi/4 or +-3pi/4 */
+	di = si * d->prev_i + sq * d->prev_q;
+	dq = sq * d->prev_i - si * d->prev_q;
+	d->prev_i = si;
+	d->prev_q = sq;
+
+	/* Raised to the 4th power, every phase step becomes pi, what is
+	 * left is 4 times the rotation by the frequency offset */
+	d2i = di*di - dq*dq;
+	d2q = 2*di*dq;
+	d4i = d2i*d2i - d2q*d2q;
+	d4q = 2*d2i*d2q;
+	ferr = atan2f(-d4q, -d4i) / 4;
+	d->freq += d->gain_freq * ferr / d->sps;
+	d->step_i = cosf(d->freq);
+	d->step_q = -sinf(d->freq);
+
+	/* keep the correction phasor on the unit circle */
+	norm = 1.0f / sqrtf(d->rot_i*d->rot_i + d->rot_q*d->rot_q);
+	d->rot_i *= norm;
+	d->rot_q *= norm;
+
+	/* the first bit is 1 for a negative, the second one for an outer
+	 * (+-3pi/4) phase step */
+	out[0] = clip_sbit(dq / d->power * SOFT_SCALE);
+	out[1] = clip_sbit(di / d->power * SOFT_SCALE);
+}
+
+unsigned int tetra_demod_run(struct tetra_demod *d, const float *iq, unsigned int n, int8_t *out)
+{
+	unsigned int i, nbits = 0;
+
+	for (i = 0; i < n; i++) {
+		float xi = iq[2*i], xq = iq[2*i+1];
+		float ri, rq, yi, yq;
+
+		/* frequency correction */
+		ri = xi * d->rot_i - xq * d->rot_q;
+		rq = xi * d->rot_q + xq * d->rot_i;
+		xi = d->rot_i * d->step_i - d->rot_q * d->step_q;
+		d->rot_q = d->rot_i * d->step_q + d->rot_q * d->step_i;
+		d->rot_i = xi;
+
+		/* matched filter */
+		d->in_pos = d->in_pos ? d->in_pos - 1 : d->ntaps - 1;
+		d->in_i[d->in_pos] = d->in_i[d->in_pos + d->ntaps] = ri;
+		d->in_q[d->in_pos] = d->in_q[d->in_pos + d->ntaps] = rq;
+		mf_dot(d, &yi, &yq);
+		d->y_i[d->y_pos & HIST_MASK] = yi;
+		d->y_q[d->y_pos & HIST_MASK] = yq;
+		d->y_pos++;
+
+		/* symbol instant within the last sample: evaluate it two
+		 * samples later, so the interpolator has samples after it */
+		d->t_next -= 1;
+		if (d->t_next <= 0) {
+			demod_symbol(d, 2 - d->t_next, out + nbits);
+			nbits += 2;
+		}
+	}
+
+	return nbits;
+}
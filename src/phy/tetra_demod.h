@@ -0,0 +1,59 @@
+#ifndef TETRA_DEMOD_H
+#define TETRA_DEMOD_H
+/* pi/4-DQPSK demodulator from complex baseband to soft bits */
+
+#include <stdint.h>
+
+#define TETRA_SYM_RATE		18000
+
+#define TETRA_DEMOD_MAX_SPS	8
+/* root raised cosine over 11 symbols, odd to have a center tap */
+#define TETRA_DEMOD_MAX_TAPS	(11*TETRA_DEMOD_MAX_SPS + 1)
+/* matched filter outputs kept for interpolation, a power of two */
+#define TETRA_DEMOD_HIST	(4*TETRA_DEMOD_MAX_SPS)
+
+struct tetra_demod {
+	float sps;			/* samples per symbol, need not be whole */
+	unsigned int ntaps;
+	float taps[TETRA_DEMOD_MAX_TAPS] __attribute__((aligned(16)));
+
+	/* input delay line of the matched filter; every sample is stored
+	 * twice (at n and n+ntaps), so the filter sees one contiguous window */
+	float in_i[2*TETRA_DEMOD_MAX_TAPS] __attribute__((aligned(16)));
+	float in_q[2*TETRA_DEMOD_MAX_TAPS] __attribute__((aligned(16)));
+	unsigned int in_pos;
+
+	/* frequency correction: the input is multiplied with the phasor
+	 * rot, which turns by rot_step every sample */
+	float freq;			/* radians per sample */
+	float rot_i, rot_q;
+	float step_i, step_q;
+
+	/* matched filter output ring */
+	float y_i[TETRA_DEMOD_HIST], y_q[TETRA_DEMOD_HIST];
+	unsigned int y_pos;
+
+	/* symbol timing: samples until the next symbol instant, and the
+	 * current estimate of the samples per symbol */
+	float t_next;
+	float omega;
+	float gain_mu, gain_omega, gain_freq;
+
+	/* previous symbol, for differential detection and timing error */
+	float prev_i, prev_q;
+	float power;			/* average symbol power */
+};
+
+/* set up a demodulator for 'sps' samples per symbol, i.e. a sample rate of
+ * sps * TETRA_SYM_RATE */
+int tetra_demod_init(struct tetra_demod *d, unsigned int sps);
+
+/* same for any sample rate from 2 to TETRA_DEMOD_MAX_SPS samples per symbol */
+int tetra_demod_init_rate(struct tetra_demod *d, unsigned int sample_rate);
+
+/* Demodulate 'n' complex samples (interleaved float I/Q) into soft bits
+ * (+127 = 0, -127 = 1), two per symbol.  'out' must have room for
+ * 2 * (2 * n / sps + 1) soft bits.  Returns the number of soft bits. */
+unsigned int tetra_demod_run(struct tetra_demod *d, const float *iq, unsigned int n, int8_t *out);
+
+#endif /* TETRA_DEMOD_H */
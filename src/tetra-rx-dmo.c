@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <getopt.h>
 
 #include <fcntl.h>
@@ -34,46 +35,21 @@
 #include <phy/tetra_burst.h>
 #include <phy/tetra_burst_sync.h>
 #include "tetra_gsmtap.h"
+#include "tetra_dump.h"
 
 #include <zmq.h>
-#include "suo.h"
-#define ENCODED_MAXLEN 0x900
+#include "tetra_suo.h"
 
 void *tetra_tall_ctx;
 void *zmq_rx_socket;
 
-int floats_to_bits(const struct frame *in, struct frame *out, size_t maxlen) 
-{
-	out->m = in->m; // Copy metadata
-	size_t len = in->m.len;
-	if (len > maxlen) len = maxlen;
-	out->m.len = len;
-
-	uint8_t buffy_in[len], buffy_out[len];
-	memcpy(buffy_in, in->data, len);
-
-	for (int i = 0; i < len; ++i) {
-		int sym = buffy_in[i];
-		if (sym < 128) {
-			buffy_out[i] = 0;
-		} else {
-			buffy_out[i] = 1;
-		}
-	}
-
-	// memcpy(out->data, buffy_out, len);
-	// purkka
-	memcpy(out->data, buffy_out+2, len-2);
-	out->m.len = len-2;
-
-	return 0;
-}
-
 int main(int argc, char **argv)
 {
 	int opt;
+	int hwm = -1;
 	struct tetra_rx_state *trs;
 	struct tetra_mac_state *tms;
+	zmq_msg_t input_msg;
 
 	tms = talloc_zero(tetra_tall_ctx, struct tetra_mac_state);
 	tetra_mac_state_init(tms);
@@ -82,48 +58,80 @@ int main(int argc, char **argv)
 	trs = talloc_zero(tetra_tall_ctx, struct tetra_rx_state);
 	trs->burst_cb_priv = tms;
 
-	while ((opt = getopt(argc, argv, "d:")) != -1) {
+	while ((opt = getopt(argc, argv, "d:l:L:H:")) != -1) {
 		switch (opt) {
 		case 'd':
 			tms->dumpdir = strdup(optarg);
 			break;
+		case 'l':
+			if (tetra_log_parse_levels(optarg) < 0) {
+				fprintf(stderr, "Invalid log levels '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'L':
+			if (tetra_list_dec_parse(tms->list_dec, optarg) < 0) {
+				fprintf(stderr, "Invalid list decoding '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'H':
+			hwm = atoi(optarg);
+			break;
 		default:
 			fprintf(stderr, "Unknown option %c\n", opt);
 		}
 	}
 
 	if (argc <= optind) {
-		fprintf(stderr, "Usage: %s [-d DUMPDIR] <rx-zmq-address>\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-d DUMPDIR] [-l LEVELS] [-L LIST] [-H MSGS] <rx-zmq-address>\n"
+			"  -L  list decode blocks failing their CRC, e.g. sch_f=16/20000,sb1=8\n"
+			"      (sb1, sb2, ndb, sch_f or all = paths[/trellis nodes per block])\n"
+			"  -H  queue up to MSGS messages while decoding lags behind (ZMQ_RCVHWM)\n",
+			argv[0]);
 		exit(1);
 	}
 
-	const char *endpoint = argv[optind];
 	void *zmq_context = zmq_ctx_new();
-    zmq_rx_socket = zmq_socket(zmq_context, ZMQ_SUB);
-    int connret = zmq_connect(zmq_rx_socket, argv[optind]);
+	zmq_rx_socket = zmq_socket(zmq_context, ZMQ_SUB);
+	/* the high water mark only applies to connections made after it */
+	if (hwm >= 0 && zmq_setsockopt(zmq_rx_socket, ZMQ_RCVHWM, &hwm, sizeof(hwm)) < 0)
+		fprintf(stderr, "Cannot set ZMQ_RCVHWM: %s\n", zmq_strerror(errno));
+	if (zmq_connect(zmq_rx_socket, argv[optind]) < 0) {
+		fprintf(stderr, "Cannot connect to %s: %s\n", argv[optind], zmq_strerror(errno));
+		exit(1);
+	}
 	zmq_setsockopt(zmq_rx_socket, ZMQ_SUBSCRIBE, "", 0);
 
-	// tetra_gsmtap_init("localhost", 0);
+	if (tms->dumpdir)
+		tms->dump = tetra_dump_alloc(tms, tms->dumpdir, TETRA_DUMP_APPEND);
 
+	// tetra_gsmtap_init(tms, "localhost", 0);
+	tetra_log_start();
+
+	/* One message object for all receives, zmq_msg_recv() releases the
+	 * previous content.  The frame is sliced from the message data
+	 * straight into the bit ring of the synchronizer.  Every part of a
+	 * multipart message carries a frame of its own; parts too short for
+	 * a frame header (e.g. a topic) are skipped. */
+	zmq_msg_init(&input_msg);
 	while (1) {
-		int nread;
-		zmq_msg_t input_msg;
-		zmq_msg_init(&input_msg);
-		nread = zmq_msg_recv(&input_msg, zmq_rx_socket, 0);
-		
-		if (nread >= 0) {
-			char encoded_buf[sizeof(struct frame) + ENCODED_MAXLEN];
-			struct frame *encoded = (struct frame *)encoded_buf;
-
-			int rc = floats_to_bits(zmq_msg_data(&input_msg), encoded, ENCODED_MAXLEN);
-
-			tetra_burst_sync_in(trs, encoded->data, encoded->m.len);
+		if (zmq_msg_recv(&input_msg, zmq_rx_socket, 0) < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			TLOGP(TLOG_DEFAULT, TLOGL_ERROR, "zmq_msg_recv: %s\n", zmq_strerror(errno));
+			break;
 		}
-		zmq_msg_close(&input_msg);
+
+		tetra_suo_frame_in(trs, zmq_msg_data(&input_msg), zmq_msg_size(&input_msg));
 	}
+	zmq_msg_close(&input_msg);
 
+	zmq_close(zmq_rx_socket);
 	zmq_ctx_destroy(zmq_context);
+	tetra_log_stop();
 
+	tetra_dump_free(tms->dump);
 	free(tms->dumpdir);
 	talloc_free(trs);
 	talloc_free(tms);
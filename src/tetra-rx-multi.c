@@ -0,0 +1,337 @@
+/* Receiver daemon decoding many suo/ZMQ channels on a pool of threads */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/stat.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/talloc.h>
+
+#include "tetra_common.h"
+#include "tetra_dump.h"
+#include <phy/tetra_burst.h>
+#include <phy/tetra_burst_sync.h>
+#include <phy/tetra_demod.h>
+
+#include <zmq.h>
+#include "tetra_suo.h"
+
+/* how long a worker waits in zmq_poll() before checking for shutdown */
+#define POLL_TIMEOUT_MS	100
+
+/* baseband samples demodulated at a time */
+#define DEMOD_CHUNK	1024
+
+void *tetra_tall_ctx;
+
+/* one input stream with its own receiver and MAC state */
+struct rx_channel {
+	unsigned int nr;
+	const char *endpoint;
+	const char *log_ctx;	/* "chN: " in front of its log lines */
+	void *zmq_sock;
+	struct tetra_rx_state *trs;
+	struct tetra_mac_state *tms;
+	struct tetra_demod *demod;	/* input is baseband, not suo frames */
+};
+
+/* A worker owns a fixed subset of the channels, so the state of a channel
+ * is only ever touched by one thread and stays in that thread's cache */
+struct rx_worker {
+	unsigned int nr;
+	pthread_t thread;
+	int cpu;		/* CPU to pin to, -1 for none */
+	struct rx_channel **chans;
+	unsigned int num_chans;
+};
+
+static void *zmq_context;
+static volatile sig_atomic_t running = 1;
+
+static void sig_handler(int signum)
+{
+	running = 0;
+}
+
+static int channel_open(struct rx_channel *ch)
+{
+	ch->zmq_sock = zmq_socket(zmq_context, ZMQ_SUB);
+	if (!ch->zmq_sock)
+		return -errno;
+
+	if (zmq_connect(ch->zmq_sock, ch->endpoint) < 0) {
+		TLOGP(TLOG_DEFAULT, TLOGL_ERROR, "channel %u: cannot connect to %s: %s\n",
+		      ch->nr, ch->endpoint, zmq_strerror(errno));
+		zmq_close(ch->zmq_sock);
+		ch->zmq_sock = NULL;
+		return -EIO;
+	}
+	zmq_setsockopt(ch->zmq_sock, ZMQ_SUBSCRIBE, "", 0);
+
+	return 0;
+}
+
+/* demodulate 'n' complex baseband samples of a channel */
+static void channel_demod(struct rx_channel *ch, const float *iq, size_t n)
+{
+	int8_t sbits[2 * DEMOD_CHUNK];
+
+	while (n) {
+		unsigned int chunk = n > DEMOD_CHUNK ? DEMOD_CHUNK : n;
+		unsigned int len;
+
+		len = tetra_demod_run(ch->demod, iq, chunk, sbits);
+		tetra_burst_sync_in_soft(ch->trs, sbits, len);
+		iq += 2 * chunk;
+		n -= chunk;
+	}
+}
+
+/* decode everything that is queued on the socket of a channel */
+static void channel_drain(struct rx_channel *ch)
+{
+	zmq_msg_t msg;
+
+	/* frames are sliced from the message straight into the bit ring */
+	zmq_msg_init(&msg);
+	while (zmq_msg_recv(&msg, ch->zmq_sock, ZMQ_DONTWAIT) >= 0) {
+		if (ch->demod)
+			channel_demod(ch, zmq_msg_data(&msg), zmq_msg_size(&msg) / (2 * sizeof(float)));
+		else
+			tetra_suo_frame_in(ch->trs, zmq_msg_data(&msg), zmq_msg_size(&msg));
+	}
+	zmq_msg_close(&msg);
+}
+
+static void *worker_main(void *arg)
+{
+	struct rx_worker *w = arg;
+	zmq_pollitem_t items[w->num_chans];
+	struct rx_channel *open_chans[w->num_chans];
+	unsigned int i, n = 0;
+
+	if (w->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+			TLOGP(TLOG_DEFAULT, TLOGL_NOTICE, "worker %u: cannot pin to CPU %d\n",
+			      w->nr, w->cpu);
+	}
+
+	/* ZMQ sockets must not migrate between threads, so each worker
+	 * creates the ones of its channels itself.  A channel that cannot
+	 * be opened is left out, the others keep running. */
+	for (i = 0; i < w->num_chans; i++) {
+		if (channel_open(w->chans[i]) < 0)
+			continue;
+		open_chans[n] = w->chans[i];
+		items[n].socket = w->chans[i]->zmq_sock;
+		items[n].fd = 0;
+		items[n].events = ZMQ_POLLIN;
+		items[n].revents = 0;
+		n++;
+	}
+	if (!n)
+		goto out;
+
+	while (running) {
+		int rc = zmq_poll(items, n, POLL_TIMEOUT_MS);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			TLOGP(TLOG_DEFAULT, TLOGL_ERROR, "worker %u: zmq_poll: %s\n",
+			      w->nr, zmq_strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (!(items[i].revents & ZMQ_POLLIN))
+				continue;
+			tetra_log_set_context(open_chans[i]->log_ctx);
+			channel_drain(open_chans[i]);
+		}
+		tetra_log_set_context(NULL);
+	}
+
+out:
+	for (i = 0; i < w->num_chans; i++) {
+		if (w->chans[i]->zmq_sock)
+			zmq_close(w->chans[i]->zmq_sock);
+		w->chans[i]->zmq_sock = NULL;
+	}
+	return NULL;
+}
+
+static void print_help(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c SPS] [-d DUMPDIR] [-l LEVELS] [-L LIST] [-w WORKERS] [-a] <rx-zmq-address>...\n"
+		"  -c  messages hold complex baseband (float I/Q) at SPS samples per symbol\n"
+		"  -d  dump traffic of channel N into DUMPDIR/chN\n"
+		"  -l  log levels, e.g. all=notice,lmac=info (debug, info, notice, error, off)\n"
+		"  -L  list decode blocks failing their CRC, e.g. sch_f=16/20000,sb1=8\n"
+		"      (sb1, sb2, ndb, sch_f or all = paths[/trellis nodes per block])\n"
+		"  -w  number of worker threads (default: one per CPU, at most one per channel)\n"
+		"  -a  pin worker N to CPU N modulo the number of CPUs\n"
+		"Log lines of channel N start with 'chN: '.\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct tetra_list_dec list_dec[_TETRA_LIST_NUM] = {};
+	const char *dumpdir = NULL;
+	struct rx_channel *chans;
+	struct rx_worker *workers;
+	unsigned int num_chans, num_workers = 0, i;
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int sps = 0;
+	int pin = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:d:l:L:w:a")) != -1) {
+		switch (opt) {
+		case 'c':
+			sps = atoi(optarg);
+			if (sps < 2 || sps > TETRA_DEMOD_MAX_SPS) {
+				fprintf(stderr, "Samples per symbol must be 2..%u\n", TETRA_DEMOD_MAX_SPS);
+				exit(1);
+			}
+			break;
+		case 'd':
+			dumpdir = optarg;
+			break;
+		case 'l':
+			if (tetra_log_parse_levels(optarg) < 0) {
+				fprintf(stderr, "Invalid log levels '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'L':
+			if (tetra_list_dec_parse(list_dec, optarg) < 0) {
+				fprintf(stderr, "Invalid list decoding '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'w':
+			num_workers = atoi(optarg);
+			break;
+		case 'a':
+			pin = 1;
+			break;
+		default:
+			fprintf(stderr, "Unknown option %c\n", opt);
+		}
+	}
+
+	if (argc <= optind) {
+		print_help(argv[0]);
+		exit(1);
+	}
+
+	if (num_cpus < 1)
+		num_cpus = 1;
+	num_chans = argc - optind;
+	if (!num_workers)
+		num_workers = num_cpus;
+	if (num_workers > num_chans)
+		num_workers = num_chans;
+
+	zmq_context = zmq_ctx_new();
+
+	chans = talloc_zero_array(tetra_tall_ctx, struct rx_channel, num_chans);
+	for (i = 0; i < num_chans; i++) {
+		struct rx_channel *ch = &chans[i];
+
+		ch->nr = i;
+		ch->endpoint = argv[optind + i];
+		ch->log_ctx = talloc_asprintf(chans, "ch%u: ", i);
+
+		ch->tms = talloc_zero(chans, struct tetra_mac_state);
+		tetra_mac_state_init(ch->tms);
+		ch->tms->infra_mode = TETRA_INFRA_DMO;
+		memcpy(ch->tms->list_dec, list_dec, sizeof(list_dec));
+		if (dumpdir) {
+			ch->tms->dumpdir = talloc_asprintf(ch->tms, "%s/ch%u", dumpdir, i);
+			if (mkdir(ch->tms->dumpdir, 0755) < 0 && errno != EEXIST) {
+				perror("mkdir");
+				exit(1);
+			}
+			ch->tms->dump = tetra_dump_alloc(ch->tms, ch->tms->dumpdir, TETRA_DUMP_APPEND);
+		}
+
+		ch->trs = talloc_zero(chans, struct tetra_rx_state);
+		ch->trs->burst_cb_priv = ch->tms;
+
+		if (sps) {
+			ch->demod = talloc_zero(chans, struct tetra_demod);
+			tetra_demod_init(ch->demod, sps);
+		}
+	}
+
+	/* channel i always runs on worker i % num_workers */
+	workers = talloc_zero_array(tetra_tall_ctx, struct rx_worker, num_workers);
+	for (i = 0; i < num_workers; i++) {
+		workers[i].nr = i;
+		workers[i].cpu = pin ? (int) (i % num_cpus) : -1;
+		workers[i].chans = talloc_zero_array(workers, struct rx_channel *,
+						     num_chans / num_workers + 1);
+	}
+	for (i = 0; i < num_chans; i++) {
+		struct rx_worker *w = &workers[i % num_workers];
+
+		w->chans[w->num_chans++] = &chans[i];
+	}
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+
+	tetra_log_start();
+
+	for (i = 0; i < num_workers; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i])) {
+			fprintf(stderr, "Cannot start worker %u\n", i);
+			exit(1);
+		}
+	}
+	for (i = 0; i < num_workers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	tetra_log_stop();
+
+	for (i = 0; i < num_chans; i++)
+		tetra_dump_free(chans[i].tms->dump);
+
+	zmq_ctx_destroy(zmq_context);
+
+	talloc_free(workers);
+	talloc_free(chans);
+
+	exit(0);
+}
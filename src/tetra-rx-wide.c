@@ -0,0 +1,264 @@
+/* Receiver decoding every 25 kHz channel of a wideband baseband recording */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <osmocom/core/utils.h>
+#include <osmocom/core/talloc.h>
+
+#include "tetra_common.h"
+#include "tetra_dump.h"
+#include <phy/tetra_burst.h>
+#include <phy/tetra_burst_sync.h>
+#include <phy/tetra_demod.h>
+#include <phy/tetra_channelizer.h>
+
+void *tetra_tall_ctx;
+
+/* wideband samples read and channelized at a time */
+#define WIDE_CHUNK	8192
+
+/* one 25 kHz channel with its own demodulator, receiver and MAC state */
+struct wide_channel {
+	int offset;		/* in channels from the center of the input */
+	unsigned int idx;	/* filterbank output */
+	const char *log_ctx;	/* "chN: " in front of its log lines */
+	struct tetra_demod demod;
+	struct tetra_rx_state *trs;
+	struct tetra_mac_state *tms;
+};
+
+/* parse a list like "-3,0,2" of channel offsets into chans[] */
+static int parse_channels(const char *list, int *chans, unsigned int max)
+{
+	unsigned int n = 0;
+	char *end;
+
+	while (*list) {
+		if (n >= max)
+			return -EINVAL;
+		chans[n++] = strtol(list, &end, 10);
+		if (end == list || (*end && *end != ','))
+			return -EINVAL;
+		list = *end ? end + 1 : end;
+	}
+
+	return n;
+}
+
+static void print_help(const char *prog)
+{
+	fprintf(stderr, "Usage: %s -r RATE [-C CHANNELS] [-f FREQ] [-d DUMPDIR] [-l LEVELS] [-L LIST] <file>\n"
+		"  -r  sample rate of the complex baseband (float I/Q) input, a power of\n"
+		"      two times 25 kHz\n"
+		"  -C  channels to decode as offsets from the center in 25 kHz steps,\n"
+		"      e.g. -4,0,3 (default: all but the one at half the sample rate)\n"
+		"  -f  shift the input by FREQ Hz first, to put the channel grid on 0 Hz\n"
+		"  -d  dump traffic of channel N into DUMPDIR/chN\n"
+		"  -l  log levels, e.g. all=notice,lmac=info (debug, info, notice, error, off)\n"
+		"  -L  list decode blocks failing their CRC, e.g. sch_f=16/20000,sb1=8\n"
+		"      (sb1, sb2, ndb, sch_f or all = paths[/trellis nodes per block])\n"
+		"Input '-' is read from stdin.  Log lines of channel N start with 'chN: '.\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct tetra_list_dec list_dec[_TETRA_LIST_NUM] = {};
+	const char *dumpdir = NULL, *chan_list = NULL;
+	struct tetra_channelizer *tc;
+	struct wide_channel *chans;
+	unsigned int rate = 0, num_chans, num_bins, max_out, i;
+	int *offsets;
+	double freq = 0, phase = 0;
+	float *iq, *out;
+	int8_t *sbits;
+	size_t have = 0;
+	int fd, opt, n;
+
+	while ((opt = getopt(argc, argv, "r:C:f:d:l:L:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'C':
+			chan_list = optarg;
+			break;
+		case 'f':
+			freq = atof(optarg);
+			break;
+		case 'd':
+			dumpdir = optarg;
+			break;
+		case 'l':
+			if (tetra_log_parse_levels(optarg) < 0) {
+				fprintf(stderr, "Invalid log levels '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'L':
+			if (tetra_list_dec_parse(list_dec, optarg) < 0) {
+				fprintf(stderr, "Invalid list decoding '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		default:
+			fprintf(stderr, "Unknown option %c\n", opt);
+		}
+	}
+
+	if (argc <= optind || !rate) {
+		print_help(argv[0]);
+		exit(1);
+	}
+
+	num_bins = rate / TETRA_CHAN_SPACING;
+	tc = tetra_channelizer_alloc(tetra_tall_ctx, num_bins);
+	if (!tc || rate % TETRA_CHAN_SPACING) {
+		fprintf(stderr, "Sample rate must be 25 kHz times a power of two from 4 to 4096\n");
+		exit(1);
+	}
+
+	offsets = talloc_zero_array(tetra_tall_ctx, int, num_bins);
+	if (chan_list) {
+		n = parse_channels(chan_list, offsets, num_bins);
+		if (n <= 0) {
+			fprintf(stderr, "Invalid channel list '%s'\n", chan_list);
+			exit(1);
+		}
+		num_chans = n;
+	} else {
+		/* every channel but the one at half the sample rate */
+		num_chans = num_bins - 1;
+		for (i = 0; i < num_chans; i++)
+			offsets[i] = (int) i + 1 - (int) num_bins / 2;
+	}
+
+	chans = talloc_zero_array(tetra_tall_ctx, struct wide_channel, num_chans);
+	for (i = 0; i < num_chans; i++) {
+		struct wide_channel *ch = &chans[i];
+
+		/* +-num_bins/2 is the same channel, at half the sample rate,
+		 * where it overlaps both band edges */
+		if (offsets[i] <= -(int) num_bins / 2 || offsets[i] >= (int) num_bins / 2) {
+			fprintf(stderr, "Channel %d is outside the input\n", offsets[i]);
+			exit(1);
+		}
+		ch->offset = offsets[i];
+		ch->idx = (offsets[i] + num_bins) % num_bins;
+		ch->log_ctx = talloc_asprintf(chans, "ch%d: ", ch->offset);
+		tetra_demod_init_rate(&ch->demod, TETRA_CHAN_OUT_RATE);
+
+		ch->tms = talloc_zero(chans, struct tetra_mac_state);
+		tetra_mac_state_init(ch->tms);
+		memcpy(ch->tms->list_dec, list_dec, sizeof(list_dec));
+		if (dumpdir) {
+			ch->tms->dumpdir = talloc_asprintf(ch->tms, "%s/ch%d", dumpdir, ch->offset);
+			if (mkdir(ch->tms->dumpdir, 0755) < 0 && errno != EEXIST) {
+				perror("mkdir");
+				exit(1);
+			}
+			ch->tms->dump = tetra_dump_alloc(ch->tms, ch->tms->dumpdir, TETRA_DUMP_APPEND);
+		}
+
+		ch->trs = talloc_zero(chans, struct tetra_rx_state);
+		ch->trs->burst_cb_priv = ch->tms;
+	}
+
+	if (!strcmp(argv[optind], "-"))
+		fd = STDIN_FILENO;
+	else
+		fd = open(argv[optind], O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		exit(2);
+	}
+
+	max_out = WIDE_CHUNK / (num_bins / 2) + 1;
+	iq = talloc_zero_array(tetra_tall_ctx, float, 2 * WIDE_CHUNK);
+	out = talloc_zero_array(tetra_tall_ctx, float, 2 * num_bins * max_out);
+	sbits = talloc_zero_array(tetra_tall_ctx, int8_t, 2 * (2 * max_out + 1));
+
+	tetra_log_start();
+
+	while (1) {
+		uint8_t *buf = (uint8_t *) iq;
+		unsigned int nsamp, nout;
+		ssize_t len;
+
+		len = read(fd, buf + have, 2 * WIDE_CHUNK * sizeof(float) - have);
+		if (len < 0) {
+			perror("read");
+			exit(1);
+		} else if (len == 0) {
+			TLOGP(TLOG_DEFAULT, TLOGL_INFO, "EOF");
+			break;
+		}
+
+		/* a partial sample stays for the next read */
+		have += len;
+		nsamp = have / (2 * sizeof(float));
+
+		if (freq != 0) {
+			double step = -2 * M_PI * freq / rate;
+
+			for (i = 0; i < nsamp; i++) {
+				float c = cos(phase), s = sin(phase);
+				float xi = iq[2*i], xq = iq[2*i+1];
+
+				iq[2*i] = xi * c - xq * s;
+				iq[2*i+1] = xi * s + xq * c;
+				phase = fmod(phase + step, 2 * M_PI);
+			}
+		}
+
+		nout = tetra_channelizer_run(tc, iq, nsamp, out, max_out);
+		for (i = 0; i < num_chans; i++) {
+			struct wide_channel *ch = &chans[i];
+			unsigned int nbits;
+
+			nbits = tetra_demod_run(&ch->demod, out + 2 * ch->idx * max_out, nout, sbits);
+			tetra_log_set_context(ch->log_ctx);
+			tetra_burst_sync_in_soft(ch->trs, sbits, nbits);
+		}
+		tetra_log_set_context(NULL);
+
+		have -= nsamp * 2 * sizeof(float);
+		memmove(buf, buf + nsamp * 2 * sizeof(float), have);
+	}
+
+	tetra_log_stop();
+
+	for (i = 0; i < num_chans; i++)
+		tetra_dump_free(chans[i].tms->dump);
+	talloc_free(chans);
+	talloc_free(offsets);
+	talloc_free(sbits);
+	talloc_free(out);
+	talloc_free(iq);
+	talloc_free(tc);
+
+	exit(0);
+}
@@ -25,6 +25,8 @@
 
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include <osmocom/core/utils.h>
 #include <osmocom/core/talloc.h>
@@ -32,16 +34,183 @@
 #include "tetra_common.h"
 #include <phy/tetra_burst.h>
 #include <phy/tetra_burst_sync.h>
+#include <phy/tetra_demod.h>
 #include "tetra_gsmtap.h"
+#include "tetra_dump.h"
 
 void *tetra_tall_ctx;
 
+/* offline mode never makes segments shorter than this many bits */
+#define SEGMENT_MIN_BITS	(1 << 20)
+
+/* segments per job, so that jobs finishing early pick up more work */
+#define SEGMENTS_PER_JOB	4
+
+/* baseband samples read and demodulated at a time */
+#define READ_SAMPLES		1024
+
+/* one span of the recording from a SYNC burst up to the next segment */
+struct segment {
+	size_t start;
+	size_t end;
+	FILE *out;		/* decoder output, merged in order */
+	pid_t pid;
+	int done;
+};
+
+static void decode_segment(struct tetra_mac_state *tms, const uint8_t *rec, int soft,
+			   const struct segment *seg)
+{
+	if (dup2(fileno(seg->out), STDOUT_FILENO) < 0) {
+		perror("dup2");
+		_exit(1);
+	}
+
+	tetra_log_start();
+	if (soft)
+		tetra_burst_sync_mem(tms, NULL, (const int8_t *) rec, seg->start, seg->end);
+	else
+		tetra_burst_sync_mem(tms, rec, NULL, seg->start, seg->end);
+	tetra_log_stop();
+	tetra_dump_free(tms->dump);
+
+	fflush(stdout);
+	_exit(0);
+}
+
+static void copy_out(FILE *in)
+{
+	char buf[65536];
+	size_t len;
+
+	rewind(in);
+	while ((len = fread(buf, 1, sizeof(buf), in)) > 0)
+		fwrite(buf, 1, len, stdout);
+	fclose(in);
+}
+
+/* Decode a whole file: map it, cut it into segments starting at SYNC
+ * bursts and decode those in up to 'jobs' processes at a time.  Each
+ * segment is decoded from scratch, which is fine as the SYNC burst it
+ * starts with tells the time and the scrambling code.  The output goes
+ * to stdout in file order.  A segment whose process fails is reported,
+ * the others are still decoded, and -1 returned in the end. */
+static int decode_offline(struct tetra_mac_state *tms, int fd, int soft, unsigned int jobs)
+{
+	struct segment *segs;
+	unsigned int num_segs, i, n, next = 0, flushed = 0, running = 0;
+	int failed = 0;
+	int dmo = tms->infra_mode == TETRA_INFRA_DMO;
+	const uint8_t *rec;
+	struct stat st;
+	size_t len;
+
+	if (fstat(fd, &st) < 0) {
+		perror("fstat");
+		return -1;
+	}
+	len = st.st_size;
+	if (!len)
+		return 0;
+
+	rec = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	if (rec == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise((void *) rec, len, MADV_SEQUENTIAL);
+
+	num_segs = jobs * SEGMENTS_PER_JOB;
+	if (num_segs > len / SEGMENT_MIN_BITS)
+		num_segs = len / SEGMENT_MIN_BITS;
+	if (!num_segs)
+		num_segs = 1;
+
+	/* segment 0 starts at the beginning, the others at the first
+	 * SYNC burst after their share of the file */
+	segs = talloc_zero_array(tetra_tall_ctx, struct segment, num_segs);
+	for (i = 1, n = 1; i < num_segs; i++) {
+		ssize_t start;
+
+		start = tetra_burst_sync_mem_find(soft ? NULL : rec, soft ? (const int8_t *) rec : NULL,
+						  len, (len / num_segs) * i, dmo);
+		if (start < 0)
+			break;
+		if ((size_t) start <= segs[n-1].start)
+			continue;
+		segs[n++].start = start;
+	}
+	num_segs = n;
+	for (i = 0; i < num_segs; i++) {
+		segs[i].end = i + 1 < num_segs ? segs[i+1].start : len;
+		segs[i].out = tmpfile();
+		if (!segs[i].out) {
+			perror("tmpfile");
+			return -1;
+		}
+	}
+
+	fflush(stdout);
+	while (flushed < num_segs) {
+		int status;
+		pid_t pid;
+
+		while (running < jobs && next < num_segs) {
+			pid = fork();
+			if (pid < 0) {
+				perror("fork");
+				return -1;
+			}
+			if (pid == 0)
+				decode_segment(tms, rec, soft, &segs[next]);
+			segs[next++].pid = pid;
+			running++;
+		}
+
+		pid = wait(&status);
+		if (pid < 0) {
+			perror("wait");
+			return -1;
+		}
+		for (i = 0; i < next; i++) {
+			if (segs[i].pid != pid)
+				continue;
+			segs[i].done = 1;
+			running--;
+			if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+				fprintf(stderr, "Decoding segment %u (bits %zu to %zu) failed\n",
+					i, segs[i].start, segs[i].end);
+				failed = 1;
+			}
+		}
+
+		/* hand out what is complete, in order */
+		while (flushed < num_segs && segs[flushed].done)
+			copy_out(segs[flushed++].out);
+	}
+	fflush(stdout);
+
+	talloc_free(segs);
+	munmap((void *) rec, len);
+
+	return failed ? -1 : 0;
+}
+
 int main(int argc, char **argv)
 {
 	int fd;
 	int opt;
+	int soft = 0;
+	int jobs = -1;
+	unsigned int sps = 0;
+	struct tetra_demod *demod = NULL;
+	/* read buffer of READ_SAMPLES baseband samples, also used for bits,
+	 * and the number of bytes of a partial sample left from the last read */
+	float iq[2 * READ_SAMPLES];
+	unsigned int have = 0;
 	struct tetra_rx_state *trs;
 	struct tetra_mac_state *tms;
+	enum tetra_dump_format dump_format = TETRA_DUMP_APPEND;
 
 	tms = talloc_zero(tetra_tall_ctx, struct tetra_mac_state);
 	tetra_mac_state_init(tms);
@@ -49,18 +218,49 @@ int main(int argc, char **argv)
 	trs = talloc_zero(tetra_tall_ctx, struct tetra_rx_state);
 	trs->burst_cb_priv = tms;
 
-	while ((opt = getopt(argc, argv, "d:")) != -1) {
+	while ((opt = getopt(argc, argv, "c:d:j:l:L:Ps")) != -1) {
 		switch (opt) {
+		case 'c':
+			sps = atoi(optarg);
+			break;
 		case 'd':
 			tms->dumpdir = strdup(optarg);
 			break;
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'l':
+			if (tetra_log_parse_levels(optarg) < 0) {
+				fprintf(stderr, "Invalid log levels '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'L':
+			if (tetra_list_dec_parse(tms->list_dec, optarg) < 0) {
+				fprintf(stderr, "Invalid list decoding '%s'\n", optarg);
+				exit(1);
+			}
+			break;
+		case 'P':
+			dump_format = TETRA_DUMP_CONTAINER;
+			break;
+		case 's':
+			soft = 1;
+			break;
 		default:
 			fprintf(stderr, "Unknown option %c\n", opt);
 		}
 	}
 
 	if (argc <= optind) {
-		fprintf(stderr, "Usage: %s [-d DUMPDIR] <file_with_1_byte_per_bit>\n", argv[0]);
+		fprintf(stderr, "Usage: %s [-c SPS] [-d DUMPDIR] [-j JOBS] [-l LEVELS] [-L LIST] [-P] [-s] <file_with_1_byte_per_bit>\n"
+			"  -c  input is complex baseband (float I/Q) at SPS samples per symbol\n"
+			"  -j  decode the whole file in segments on JOBS processes (0: one per CPU)\n"
+			"  -l  log levels, e.g. all=notice,lmac=info (debug, info, notice, error, off)\n"
+			"  -L  list decode blocks failing their CRC, e.g. sch_f=16/20000,sb1=8\n"
+			"      (sb1, sb2, ndb, sch_f or all = paths[/trellis nodes per block])\n"
+			"  -P  dump traffic into one container file per call\n"
+			"  -s  input holds soft bits (int8_t, +127 = 0, -127 = 1)\n", argv[0]);
 		exit(1);
 	}
 
@@ -70,24 +270,76 @@ int main(int argc, char **argv)
 		exit(2);
 	}
 
-	tetra_gsmtap_init("localhost", 0);
+	if (sps) {
+		demod = talloc_zero(tetra_tall_ctx, struct tetra_demod);
+		if (tetra_demod_init(demod, sps) < 0) {
+			fprintf(stderr, "Samples per symbol must be 2..%u\n", TETRA_DEMOD_MAX_SPS);
+			exit(1);
+		}
+		if (jobs >= 0) {
+			fprintf(stderr, "Offline decoding needs bits, not baseband\n");
+			exit(1);
+		}
+	}
+
+	/* segments decoded in parallel would append to the dump files
+	 * out of order, and split calls between processes */
+	if (tms->dumpdir && jobs >= 0) {
+		fprintf(stderr, "Dumping traffic needs the input in order, not -j\n");
+		exit(1);
+	}
+	if (tms->dumpdir)
+		tms->dump = tetra_dump_alloc(tms, tms->dumpdir, dump_format);
+
+	tetra_gsmtap_init(tms, "localhost", 0);
+
+	if (jobs >= 0) {
+		if (jobs == 0)
+			jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if (jobs < 1)
+			jobs = 1;
+		if (decode_offline(tms, fd, soft, jobs) < 0)
+			exit(1);
+		goto out;
+	}
+
+	tetra_log_start();
 
 	while (1) {
-		uint8_t buf[64];
+		uint8_t *buf = (uint8_t *) iq;
+		int8_t sbits[2 * READ_SAMPLES];
 		int len;
 
-		len = read(fd, buf, sizeof(buf));
+		len = read(fd, buf + have, sizeof(iq) - have);
 		if (len < 0) {
 			perror("read");
 			exit(1);
 		} else if (len == 0) {
-			printf("EOF");
+			TLOGP(TLOG_DEFAULT, TLOGL_INFO, "EOF");
 			break;
 		}
-		tetra_burst_sync_in(trs, buf, len);
+		if (demod) {
+			unsigned int n;
+
+			/* a partial sample stays for the next read */
+			have += len;
+			n = have / (2 * sizeof(float));
+			len = tetra_demod_run(demod, iq, n, sbits);
+			have -= n * 2 * sizeof(float);
+			memmove(buf, buf + n * 2 * sizeof(float), have);
+			tetra_burst_sync_in_soft(trs, sbits, len);
+		} else if (soft)
+			tetra_burst_sync_in_soft(trs, (int8_t *) buf, len);
+		else
+			tetra_burst_sync_in(trs, buf, len);
 	}
 
+	tetra_log_stop();
+
+out:
+	tetra_dump_free(tms->dump);
 	free(tms->dumpdir);
+	talloc_free(demod);
 	talloc_free(trs);
 	talloc_free(tms);
 
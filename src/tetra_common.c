@@ -20,10 +20,15 @@
 
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include <osmocom/core/utils.h>
 #include <osmocom/core/bits.h>
+#include <osmocom/core/talloc.h>
+
+#include <lower_mac/viterbi_k5.h>
 
 #include "tetra_common.h"
 #include "tetra_prim.h"
@@ -38,6 +43,12 @@ uint32_t bits_to_uint(const uint8_t *bits, unsigned int len)
 	return ret;
 }
 
+void tetra_ubits2sbits(int8_t *out, const uint8_t *in, unsigned int len)
+{
+	while (len--)
+		*out++ = tetra_ubit2sbit(*in++);
+}
+
 static inline uint32_t tetra_band_base_hz(uint8_t band)
 {
 	return (band * 100000000);
@@ -130,4 +141,63 @@ const char *tetra_get_sap_name(uint8_t sap)
 void tetra_mac_state_init(struct tetra_mac_state *tms)
 {
 	INIT_LLIST_HEAD(&tms->voice_channels);
+	INIT_LLIST_HEAD(&tms->llcs.rx.defrag_list);
+	tms->tun_fd = -1;
+	tms->prim_pool = talloc_zero(tms, struct tetra_prim_pool);
+	tetra_prim_pool_init(tms->prim_pool);
+}
+
+static const struct value_string tetra_list_chan_names[] = {
+	{ TETRA_LIST_SB1,	"sb1" },
+	{ TETRA_LIST_SB2,	"sb2" },
+	{ TETRA_LIST_NDB,	"ndb" },
+	{ TETRA_LIST_SCH_F,	"sch_f" },
+	{ 0, NULL }
+};
+
+int tetra_list_dec_parse(struct tetra_list_dec *ld, const char *spec)
+{
+	char *dup = strdup(spec), *tok, *save = NULL;
+	int rc = 0;
+
+	for (tok = strtok_r(dup, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		struct tetra_list_dec set;
+		unsigned long paths, budget = 0;
+		char *eq = strchr(tok, '='), *end;
+		int chan;
+
+		if (!eq) {
+			rc = -EINVAL;
+			break;
+		}
+		*eq = '\0';
+
+		errno = 0;
+		paths = strtoul(eq + 1, &end, 10);
+		if (*end == '/')
+			budget = strtoul(end + 1, &end, 10);
+		if (end == eq + 1 || *end || errno ||
+		    paths > VITERBI_K5_LIST_MAX_PATHS || budget > VITERBI_K5_LIST_MAX_BUDGET) {
+			rc = -EINVAL;
+			break;
+		}
+		set.paths = paths;
+		set.budget = budget;
+
+		if (!strcmp(tok, "all")) {
+			for (chan = 0; chan < _TETRA_LIST_NUM; chan++)
+				ld[chan] = set;
+			continue;
+		}
+
+		chan = get_string_value(tetra_list_chan_names, tok);
+		if (chan < 0) {
+			rc = -EINVAL;
+			break;
+		}
+		ld[chan] = set;
+	}
+
+	free(dup);
+	return rc;
 }
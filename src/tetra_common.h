@@ -2,14 +2,13 @@
 #define TETRA_COMMON_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "tetra_mac_pdu.h"
 #include <osmocom/core/linuxlist.h>
 
-#ifdef DEBUG
-#define DEBUGP(x, args...)	printf(x, ## args)
-#else
-#define DEBUGP(x, args...)	do { } while(0)
-#endif
+#include "tetra_log.h"
+
+#define DEBUGP(x, args...)	TLOGP(TLOG_DEFAULT, TLOGL_DEBUG, x, ## args)
 
 #define TETRA_SYM_PER_TS	255
 #define TETRA_BITS_PER_TS	(TETRA_SYM_PER_TS*2)
@@ -41,12 +40,69 @@ enum tetra_log_chan {
 
 uint32_t bits_to_uint(const uint8_t *bits, unsigned int len);
 
+/* soft bits: int8_t LLRs, +127 is a certain 0, -127 a certain 1 and 0 an
+ * erasure (the convention of osmo_conv_decode()) */
+static inline int8_t tetra_ubit2sbit(uint8_t bit)
+{
+	return bit ? -127 : 127;
+}
+
+static inline uint8_t tetra_sbit2ubit(int8_t sbit)
+{
+	return sbit < 0;
+}
+
+void tetra_ubits2sbits(int8_t *out, const uint8_t *in, unsigned int len);
+
 #include "tetra_tdma.h"
+#include "tetra_llc_pdu.h"
+#include <lower_mac/tetra_scramb.h>
+
 struct tetra_phy_state {
 	struct tetra_tdma_time time;
+	/* DMO: slots (bit 0 = timeslot 1) of the DM channel the last good
+	 * DMAC-SYNC came in on, i.e. 1 and 3 (channel A) or 2 and 4
+	 * (channel B); 0 while not known */
+	uint8_t dmo_slots;
 };
-extern struct tetra_phy_state t_phy_state;
 
+/* what the lower MAC learnt about the cell from its SYNC PDUs */
+struct tetra_cell_data {
+	uint16_t mcc;
+	uint16_t mnc;
+	uint8_t colour_code;
+	struct tetra_tdma_time time;
+
+	uint32_t scramb_init;
+	/* scrambling sequences of the cell and of SB1 (SCRAMB_INIT) */
+	struct tetra_scramb_seq scramb_seq;
+	struct tetra_scramb_seq sb1_scramb_seq;
+};
+
+/* logical channels whose blocks may be list decoded */
+enum tetra_list_chan {
+	TETRA_LIST_SB1,		/* SB1 resp. DSB1 */
+	TETRA_LIST_SB2,		/* SB2 resp. DSB2 */
+	TETRA_LIST_NDB,
+	TETRA_LIST_SCH_F,
+	_TETRA_LIST_NUM
+};
+
+/* List Viterbi decoding of the blocks of a channel that fail their CRC:
+ * the most likely decodings are tried against the CRC in turn */
+struct tetra_list_dec {
+	unsigned int paths;	/* decodings tried, 0 or 1: off */
+	unsigned int budget;	/* trellis nodes searched per block, 0: paths
+				 * times the trellis length */
+};
+
+struct gsmtap_inst;
+struct tetra_prim_pool;
+struct tetra_dump;
+
+/* State of one receiver.  It is handed to the burst synchronizer as
+ * burst_cb_priv and from there to the lower and upper MAC, so decoders
+ * with separate states may run concurrently. */
 struct tetra_mac_state {
 	struct llist_head voice_channels;
 	struct {
@@ -55,13 +111,31 @@ struct tetra_mac_state {
 	struct tetra_si_decoded last_sid;
 
 	char *dumpdir;	/* Where to save traffic channel dump */
+	struct tetra_dump *dump;	/* traffic channel dump writers, if any */
 	int ssi;	/* SSI */
 	int tsn;	/* Timeslot number */
 	enum tetra_infrastructure_mode infra_mode;
+	struct tetra_list_dec list_dec[_TETRA_LIST_NUM];
+	void *list_mem;		/* storage of the list search, kept for the next block */
+	size_t list_mem_size;
+
+	struct tetra_phy_state phy_state;	/* TDMA time of the burst sync */
+	struct tetra_cell_data cell;
+	struct tllc_state llcs;
+	int tun_fd;
+	struct gsmtap_inst *gsmtap;
+	struct tetra_prim_pool *prim_pool;	/* lower to upper MAC primitives */
 };
 
+/* tms must have been allocated with talloc */
 void tetra_mac_state_init(struct tetra_mac_state *tms);
 
+/* Fill the _TETRA_LIST_NUM list decoding settings 'ld' from a spec like
+ * "sch_f=16/20000,sb1=8", i.e. channel (sb1, sb2, ndb, sch_f or all) =
+ * paths[/budget].  Returns -EINVAL for a malformed spec or values above
+ * VITERBI_K5_LIST_MAX_PATHS resp. VITERBI_K5_LIST_MAX_BUDGET. */
+int tetra_list_dec_parse(struct tetra_list_dec *ld, const char *spec);
+
 #define TETRA_CRC_OK	0x1d0f
 
 uint32_t tetra_dl_carrier_hz(uint8_t band, uint16_t carrier, uint8_t offset);
@@ -0,0 +1,294 @@
+/* Buffered dump of traffic channel blocks, one writer per call
+ *
+ * Every call (usage marker and timeslot) keeps its files open with a
+ * buffer of whole records, which goes out in one write() to a file
+ * opened O_APPEND, so processes dumping into the same directory never
+ * split each other's records.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+
+#include <osmocom/core/talloc.h>
+
+#include "tetra_common.h"
+#include "tetra_dump.h"
+
+/* calls with open writers */
+#define DUMP_MAX_CALLS		32
+
+/* blocks buffered per call, about 90 kB, or 2.5 s of one call */
+#define DUMP_BUF_BLOCKS		64
+
+/* TDMA frames in a hyperframe, after which the time wraps */
+#define DUMP_HYPERFRAME		(60 * 18)
+
+/* longest line of the .txt file */
+#define DUMP_SSI_LINE		12
+
+struct dump_file {
+	int fd;
+	uint8_t *buf;
+	size_t len, size;
+};
+
+struct dump_call {
+	int usage;		/* 0: writer not in use */
+	int tn;
+	unsigned int last;	/* TDMA frame of the last block */
+	uint32_t num_records;
+	struct dump_file data;
+	struct dump_file ssi;	/* TETRA_DUMP_APPEND only */
+};
+
+struct tetra_dump {
+	char *dir;
+	enum tetra_dump_format format;
+	unsigned int seq;	/* next container file number to try */
+	struct dump_call calls[DUMP_MAX_CALLS];
+};
+
+static unsigned int dump_frame(const struct tetra_tdma_time *tm)
+{
+	return ((tm->mn - 1) * 18 + tm->fn - 1) % DUMP_HYPERFRAME;
+}
+
+static int dump_file_open(struct tetra_dump *td, struct dump_file *f, const char *fname,
+			  int flags, size_t size)
+{
+	f->fd = open(fname, O_WRONLY | O_CREAT | flags, 0644);
+	if (f->fd < 0)
+		return -errno;
+
+	f->buf = talloc_size(td, size);
+	f->size = size;
+	f->len = 0;
+	return 0;
+}
+
+static void dump_file_flush(struct dump_file *f)
+{
+	size_t off = 0;
+
+	while (off < f->len) {
+		ssize_t rc = write(f->fd, f->buf + off, f->len - off);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			TLOGP(TLOG_LMAC, TLOGL_ERROR, "traffic dump: write: %s\n", strerror(errno));
+			break;
+		}
+		off += rc;
+	}
+	f->len = 0;
+}
+
+/* records are never split across flushes */
+static void dump_file_put(struct dump_file *f, const void *data, size_t len)
+{
+	if (f->len + len > f->size)
+		dump_file_flush(f);
+	memcpy(f->buf + f->len, data, len);
+	f->len += len;
+}
+
+static void dump_file_close(struct dump_file *f)
+{
+	if (f->fd < 0)
+		return;
+	dump_file_flush(f);
+	close(f->fd);
+	talloc_free(f->buf);
+	f->fd = -1;
+	f->buf = NULL;
+}
+
+static int dump_call_open(struct tetra_dump *td, struct dump_call *call, int usage, int tn)
+{
+	char fname[PATH_MAX];
+	int rc;
+
+	call->data.fd = call->ssi.fd = -1;
+
+	if (td->format == TETRA_DUMP_APPEND) {
+		snprintf(fname, sizeof(fname), "%s/traffic_%d_%d.out", td->dir, usage, tn);
+		rc = dump_file_open(td, &call->data, fname, O_APPEND,
+				    DUMP_BUF_BLOCKS * TETRA_DUMP_BLOCK_WORDS * sizeof(int16_t));
+		if (rc < 0)
+			goto err;
+		snprintf(fname, sizeof(fname), "%s/traffic_%d_%d.txt", td->dir, usage, tn);
+		rc = dump_file_open(td, &call->ssi, fname, O_APPEND, DUMP_BUF_BLOCKS * DUMP_SSI_LINE);
+		if (rc < 0)
+			goto err;
+	} else {
+		struct tetra_dump_hdr hdr = {
+			.magic = TETRA_DUMP_MAGIC,
+			.version = 1,
+			.usage = usage,
+			.tn = tn,
+			.record_size = sizeof(struct tetra_dump_record),
+		};
+
+		/* the first free number, also against other processes */
+		do {
+			snprintf(fname, sizeof(fname), "%s/call_%u_%d_%d.dump", td->dir,
+				 td->seq++, usage, tn);
+			rc = dump_file_open(td, &call->data, fname, O_EXCL | O_APPEND,
+					    DUMP_BUF_BLOCKS * sizeof(struct tetra_dump_record));
+		} while (rc == -EEXIST);
+		if (rc < 0)
+			goto err;
+		dump_file_put(&call->data, &hdr, sizeof(hdr));
+	}
+
+	call->usage = usage;
+	call->tn = tn;
+	call->num_records = 0;
+	return 0;
+
+err:
+	TLOGP(TLOG_LMAC, TLOGL_ERROR, "traffic dump: cannot open %s: %s\n", fname, strerror(-rc));
+	dump_file_close(&call->data);
+	return rc;
+}
+
+static void dump_call_close(struct tetra_dump *td, struct dump_call *call)
+{
+	if (td->format == TETRA_DUMP_CONTAINER) {
+		struct tetra_dump_trailer trl = {
+			.magic = TETRA_DUMP_TRAILER,
+			.num_records = call->num_records,
+		};
+
+		dump_file_put(&call->data, &trl, sizeof(trl));
+	}
+	dump_file_close(&call->data);
+	dump_file_close(&call->ssi);
+	call->usage = 0;
+}
+
+struct tetra_dump *tetra_dump_alloc(void *ctx, const char *dir, enum tetra_dump_format format)
+{
+	struct tetra_dump *td;
+
+	td = talloc_zero(ctx, struct tetra_dump);
+	if (!td)
+		return NULL;
+	td->dir = talloc_strdup(td, dir);
+	td->format = format;
+
+	return td;
+}
+
+void tetra_dump_free(struct tetra_dump *td)
+{
+	unsigned int i;
+
+	if (!td)
+		return;
+
+	for (i = 0; i < DUMP_MAX_CALLS; i++) {
+		if (td->calls[i].usage)
+			dump_call_close(td, &td->calls[i]);
+	}
+	talloc_free(td);
+}
+
+void tetra_dump_expire(struct tetra_dump *td, const struct tetra_tdma_time *tm)
+{
+	unsigned int now = dump_frame(tm), i;
+
+	for (i = 0; i < DUMP_MAX_CALLS; i++) {
+		struct dump_call *call = &td->calls[i];
+
+		if (call->usage &&
+		    (now + DUMP_HYPERFRAME - call->last) % DUMP_HYPERFRAME > TETRA_DUMP_IDLE_FRAMES)
+			dump_call_close(td, call);
+	}
+}
+
+void tetra_dump_traffic(struct tetra_dump *td, int usage, int tn, int ssi,
+			const struct tetra_tdma_time *tm, const int8_t *type4)
+{
+	struct dump_call *call = NULL, *free_call = NULL;
+	struct tetra_dump_record rec;
+	int16_t *block = rec.block;
+	unsigned int i;
+
+	for (i = 0; i < DUMP_MAX_CALLS; i++) {
+		struct dump_call *c = &td->calls[i];
+
+		if (!c->usage) {
+			if (!free_call)
+				free_call = c;
+		} else if (c->tn == tn && c->usage == usage) {
+			call = c;
+		} else if (c->tn == tn) {
+			/* a new call took over the timeslot */
+			dump_call_close(td, c);
+			if (!free_call)
+				free_call = c;
+		}
+	}
+	if (!call) {
+		if (!free_call || dump_call_open(td, free_call, usage, tn) < 0)
+			return;
+		call = free_call;
+	}
+	call->last = dump_frame(tm);
+
+	/* Generate a block */
+	memset(&rec, 0, sizeof(rec));
+	for (i = 0; i < 6; i++)
+		block[115*i] = 0x6b21 + i;
+
+	for (i = 0; i < 114; i++)
+		block[1+i] = type4[i];
+
+	for (i = 0; i < 114; i++)
+		block[116+i] = type4[114+i];
+
+	for (i = 0; i < 114; i++)
+		block[231+i] = type4[228+i];
+
+	for (i = 0; i < 90; i++)
+		block[346+i] = type4[342+i];
+
+	if (td->format == TETRA_DUMP_APPEND) {
+		char line[DUMP_SSI_LINE + 1];
+		int len;
+
+		dump_file_put(&call->data, block, sizeof(rec.block));
+		len = snprintf(line, sizeof(line), "%d\n", ssi);
+		dump_file_put(&call->ssi, line, len);
+	} else {
+		rec.hn = tm->hn;
+		rec.mn = tm->mn;
+		rec.fn = tm->fn;
+		rec.tn = tm->tn;
+		rec.ssi = ssi;
+		dump_file_put(&call->data, &rec, sizeof(rec));
+		call->num_records++;
+	}
+}
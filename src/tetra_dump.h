@@ -0,0 +1,69 @@
+#ifndef TETRA_DUMP_H
+#define TETRA_DUMP_H
+/* Buffered dump of traffic channel blocks, one writer per call */
+
+#include <stdint.h>
+
+#include "tetra_tdma.h"
+
+/* int16_t words of a dumped block: six 0x6b21 + i markers in front of the
+ * four parts of the type-4 soft bits, the input format of the ETSI
+ * channel decoder */
+#define TETRA_DUMP_BLOCK_WORDS	690
+
+/* a call whose slot saw no traffic for this many TDMA frames has ended */
+#define TETRA_DUMP_IDLE_FRAMES	72
+
+enum tetra_dump_format {
+	/* traffic_<usage>_<tn>.out with the blocks and .txt with the SSI
+	 * of each block, appended to */
+	TETRA_DUMP_APPEND,
+	/* one call_<seq>_<usage>_<tn>.dump per call: a header, records of
+	 * the TDMA time, SSI and block of a fixed size, so record k is at
+	 * a known offset, and a trailer with the number of records */
+	TETRA_DUMP_CONTAINER,
+};
+
+#define TETRA_DUMP_MAGIC	"TETRADMP"
+#define TETRA_DUMP_TRAILER	"TDIX"
+
+/* all fields native endian */
+struct tetra_dump_hdr {
+	char magic[8];			/* TETRA_DUMP_MAGIC */
+	uint32_t version;		/* 1 */
+	int32_t usage;			/* usage marker of the call */
+	int32_t tn;			/* timeslot of the call */
+	uint32_t record_size;		/* sizeof(struct tetra_dump_record) */
+};
+
+struct tetra_dump_record {
+	uint16_t hn;
+	uint8_t mn, fn, tn;
+	uint8_t pad[3];
+	int32_t ssi;
+	int16_t block[TETRA_DUMP_BLOCK_WORDS];
+};
+
+struct tetra_dump_trailer {
+	char magic[4];			/* TETRA_DUMP_TRAILER */
+	uint32_t num_records;
+};
+
+struct tetra_dump;
+
+/* Dump into the existing directory 'dir'.  Writers stay open and buffer
+ * until their call ends or goes idle, or tetra_dump_free() is called. */
+struct tetra_dump *tetra_dump_alloc(void *ctx, const char *dir, enum tetra_dump_format format);
+
+/* flush and close all writers */
+void tetra_dump_free(struct tetra_dump *td);
+
+/* Dump the 432 type-4 soft bits of a traffic block of a call.  A writer
+ * of another call on the same timeslot is closed, as that call ended. */
+void tetra_dump_traffic(struct tetra_dump *td, int usage, int tn, int ssi,
+			const struct tetra_tdma_time *tm, const int8_t *type4);
+
+/* close the writers of calls idle for TETRA_DUMP_IDLE_FRAMES */
+void tetra_dump_expire(struct tetra_dump *td, const struct tetra_tdma_time *tm);
+
+#endif /* TETRA_DUMP_H */
@@ -14,8 +14,6 @@
 #include "tetra_common.h"
 #include "tetra_tdma.h"
 
-static struct gsmtap_inst *g_gti = NULL;
-
 static const uint8_t lchan2gsmtap[] = {
 	[TETRA_LC_SCH_F]	= GSMTAP_TETRA_SCH_F,
 	[TETRA_LC_SCH_HD]	= GSMTAP_TETRA_SCH_HD,
@@ -47,7 +45,6 @@ struct msgb *tetra_gsmtap_makemsg(struct tetra_tdma_time *tm, enum tetra_log_cha
 	gh->hdr_len = sizeof(*gh)/4;
 	gh->type = GSMTAP_TYPE_TETRA_I1;
 	gh->timeslot = ts;
-	tms->tsn = ts;
 	gh->sub_slot = ss;
 	gh->snr_db = snr;
 	gh->signal_dbm = signal_dbm;
@@ -62,20 +59,20 @@ struct msgb *tetra_gsmtap_makemsg(struct tetra_tdma_time *tm, enum tetra_log_cha
 	return msg;
 }
 
-int tetra_gsmtap_sendmsg(struct msgb *msg)
+int tetra_gsmtap_sendmsg(struct tetra_mac_state *tms, struct msgb *msg)
 {
-	if (g_gti)
-		return gsmtap_sendmsg(g_gti, msg);
+	if (tms->gsmtap)
+		return gsmtap_sendmsg(tms->gsmtap, msg);
 	else
 		return 0;
 }
 
-int tetra_gsmtap_init(const char *host, uint16_t port)
+int tetra_gsmtap_init(struct tetra_mac_state *tms, const char *host, uint16_t port)
 {
-	g_gti = gsmtap_source_init(host, port, 0);
-	if (!g_gti)
+	tms->gsmtap = gsmtap_source_init(host, port, 0);
+	if (!tms->gsmtap)
 		return -EINVAL;
-	gsmtap_source_add_sink(g_gti);
+	gsmtap_source_add_sink(tms->gsmtap);
 
 	return 0;
 }
@@ -6,8 +6,8 @@ struct msgb *tetra_gsmtap_makemsg(struct tetra_tdma_time *tm, enum tetra_log_cha
 				  int8_t signal_dbm, uint8_t snr, const uint8_t *bitdata, unsigned int bitlen,
 				  struct tetra_mac_state *tms);
 
-int tetra_gsmtap_sendmsg(struct msgb *msg);
+int tetra_gsmtap_sendmsg(struct tetra_mac_state *tms, struct msgb *msg);
 
-int tetra_gsmtap_init(const char *host, uint16_t port);
+int tetra_gsmtap_init(struct tetra_mac_state *tms, const char *host, uint16_t port);
 
 #endif
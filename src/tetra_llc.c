@@ -27,15 +27,10 @@
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/bits.h>
 
+#include "tetra_common.h"
 #include "tetra_llc_pdu.h"
 
-static int tun_fd = -1;
-
-static struct tllc_state g_llcs = {
-	.rx.defrag_list = LLIST_HEAD_INIT(g_llcs.rx.defrag_list),
-};
-
-int rx_tl_sdu(struct msgb *msg, unsigned int len);
+int rx_tl_sdu(struct tetra_mac_state *tms, struct msgb *msg, unsigned int len);
 
 static struct tllc_defrag_q_e *
 get_dqe_for_ns(struct tllc_state *llcs, uint8_t ns, int alloc_if_missing)
@@ -69,35 +64,35 @@ static int tllc_defrag_in(struct tllc_state *llcs,
 	if (!dqe->last_ss ||
 	    (dqe->last_ss == lpp->ss - 1)) {
 		/* FIXME: append */
-		printf("<<APPEND:%u>> ", lpp->ss);
+		TLOGP(TLOG_LLC, TLOGL_INFO, "<<APPEND:%u>> ", lpp->ss);
 		dqe->last_ss = lpp->ss;
 		memcpy(msgb_put(dqe->tl_sdu, len), msg->l3h, len);
 	} else
-		printf("<<MISS:%u-%u>> ", dqe->last_ss, lpp->ss);
+		TLOGP(TLOG_LLC, TLOGL_INFO, "<<MISS:%u-%u>> ", dqe->last_ss, lpp->ss);
 
 	return 0;
 }
 
-static int tllc_defrag_out(struct tllc_state *llcs,
+static int tllc_defrag_out(struct tetra_mac_state *tms,
 			   struct tetra_llc_pdu *lpp)
 {
 	struct tllc_defrag_q_e *dqe;
 	struct msgb *msg;
 
-	dqe = get_dqe_for_ns(llcs, lpp->ns, 0);
+	dqe = get_dqe_for_ns(&tms->llcs, lpp->ns, 0);
 	msg = dqe->tl_sdu;
 
-	printf("<<REMOVE>> ");
+	TLOGP(TLOG_LLC, TLOGL_INFO, "<<REMOVE>> ");
 	msg->l3h = msg->data;
-	rx_tl_sdu(msg, msgb_l3len(msg));
+	rx_tl_sdu(tms, msg, msgb_l3len(msg));
 
-	if (tun_fd < 0)
-		tun_fd = tun_alloc("tun0");
-		fprintf(stderr, "tun_fd=%d\n", tun_fd);
-	if (tun_fd >= 0) {
+	if (tms->tun_fd < 0)
+		tms->tun_fd = tun_alloc("tun0");
+		fprintf(stderr, "tun_fd=%d\n", tms->tun_fd);
+	if (tms->tun_fd >= 0) {
 		uint8_t buf[4096];
 		int len = osmo_ubit2pbit(buf, msg->l3h+3+4+4+4+4, msgb_l3len(msg)-3-4-4-4-4);
-		write(tun_fd, buf, len);
+		write(tms->tun_fd, buf, len);
 	}
 
 	llist_del(&dqe->list);
@@ -107,7 +102,7 @@ static int tllc_defrag_out(struct tllc_state *llcs,
 
 /* Receive TM-SDU (MAC SDU == LLC PDU) */
 /* this resembles TMA-UNITDATA.ind (TM-SDU / length) */
-int rx_tm_sdu(struct msgb *msg, unsigned int len)
+int rx_tm_sdu(struct tetra_mac_state *tms, struct msgb *msg, unsigned int len)
 {
 	struct tetra_llc_pdu lpp;
 
@@ -115,7 +110,7 @@ int rx_tm_sdu(struct msgb *msg, unsigned int len)
 	tetra_llc_pdu_parse(&lpp, msg->l2h, len);
 	msg->l3h = lpp.tl_sdu;
 
-	printf("TM-SDU(%s,%u,%u): ",
+	TLOGP(TLOG_LLC, TLOGL_INFO, "TM-SDU(%s,%u,%u): ",
 		tetra_get_llc_pdut_dec_name(lpp.pdu_type), lpp.ns, lpp.ss);
 
 	switch (lpp.pdu_type) {
@@ -129,29 +124,29 @@ int rx_tm_sdu(struct msgb *msg, unsigned int len)
 	case TLLC_PDUT_DEC_AL_RECONNECT:
 	case TLLC_PDUT_DEC_AL_DISC:
 		/* directly hand it to MLE */
-		rx_tl_sdu(msg, lpp.tl_sdu_len);
+		rx_tl_sdu(tms, msg, lpp.tl_sdu_len);
 		break;
 	case TLLC_PDUT_DEC_AL_DATA:
 	case TLLC_PDUT_DEC_AL_UDATA:
 	case TLLC_PDUT_DEC_ALX_DATA:
 	case TLLC_PDUT_DEC_ALX_UDATA:
 		/* input into LLC defragmenter */
-		tllc_defrag_in(&g_llcs, &lpp, msg, len);
+		tllc_defrag_in(&tms->llcs, &lpp, msg, len);
 		break;
 	case TLLC_PDUT_DEC_AL_FINAL:
 	case TLLC_PDUT_DEC_AL_UFINAL:
 	case TLLC_PDUT_DEC_ALX_FINAL:
 	case TLLC_PDUT_DEC_ALX_UFINAL:
 		/* input into LLC defragmenter */
-		tllc_defrag_in(&g_llcs, &lpp, msg, len);
+		tllc_defrag_in(&tms->llcs, &lpp, msg, len);
 		/* check if the fragment is complete and hand it off*/
-		tllc_defrag_out(&g_llcs, &lpp);
+		tllc_defrag_out(tms, &lpp);
 		break;
 	}
 
 	if (lpp.tl_sdu && lpp.ss == 0) {
 		/* this resembles TMA-UNITDATA.ind */
-		//rx_tl_sdu(msg, lpp.tl_sdu_len);
+		//rx_tl_sdu(tms, msg, lpp.tl_sdu_len);
 	}
 	return len;
 }
@@ -0,0 +1,334 @@
+/* Decoder logging with per-subsystem levels
+ *
+ * Messages are formatted on the decoding thread and, once tetra_log_start()
+ * has been called, appended to a single-producer single-consumer ring of
+ * that thread.  A writer thread drains the rings into stdio, so decoders
+ * never block in write(2), on the stdio locks or on each other.
+ */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <osmocom/core/utils.h>
+
+#include "tetra_log.h"
+
+uint8_t tetra_log_level[_TLOG_NUM] = {
+	[TLOG_DEFAULT]	= TLOGL_INFO,
+	[TLOG_PHY]	= TLOGL_INFO,
+	[TLOG_LMAC]	= TLOGL_INFO,
+	[TLOG_UMAC]	= TLOGL_INFO,
+	[TLOG_LLC]	= TLOGL_INFO,
+};
+
+static const struct value_string subsys_names[] = {
+	{ TLOG_DEFAULT,	"default" },
+	{ TLOG_PHY,	"phy" },
+	{ TLOG_LMAC,	"lmac" },
+	{ TLOG_UMAC,	"umac" },
+	{ TLOG_LLC,	"llc" },
+	{ 0, NULL }
+};
+
+static const struct value_string level_names[] = {
+	{ TLOGL_DEBUG,	"debug" },
+	{ TLOGL_INFO,	"info" },
+	{ TLOGL_NOTICE,	"notice" },
+	{ TLOGL_ERROR,	"error" },
+	{ TLOGL_OFF,	"off" },
+	{ 0, NULL }
+};
+
+#define TLOG_RING_SIZE	(1 << 20)
+#define TLOG_MSG_MAX	4096
+/* record header: 16 bit length, stream, end of line flag */
+#define TLOG_HDR_LEN	4
+
+struct tlog_ring {
+	struct tlog_ring *next;
+	/* free running, only written by the producer resp. the consumer */
+	uint32_t head;
+	uint32_t tail;
+	uint8_t buf[TLOG_RING_SIZE];
+};
+
+/* the rings of all threads that ever logged, never shrinks */
+static struct tlog_ring *tlog_rings;
+static __thread struct tlog_ring *tlog_my_ring;
+/* line prefix of the calling thread, and whether its last message ended
+ * in the middle of a line */
+static __thread const char *tlog_ctx;
+static __thread int tlog_mid_line;
+static pthread_t tlog_thread;
+static int tlog_running;
+static int tlog_stopping;
+
+void tetra_log_set_level(enum tetra_log_subsys ss, int level)
+{
+	if (ss < _TLOG_NUM)
+		tetra_log_level[ss] = level;
+}
+
+void tetra_log_set_context(const char *ctx)
+{
+	tlog_ctx = ctx;
+	tlog_mid_line = 0;
+}
+
+int tetra_log_parse_levels(const char *spec)
+{
+	char *dup = strdup(spec), *tok, *save = NULL;
+	int rc = 0;
+
+	for (tok = strtok_r(dup, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		char *eq = strchr(tok, '=');
+		int ss, level;
+
+		if (!eq) {
+			rc = -EINVAL;
+			break;
+		}
+		*eq = '\0';
+
+		level = get_string_value(level_names, eq + 1);
+		if (level < 0) {
+			rc = -EINVAL;
+			break;
+		}
+
+		if (!strcmp(tok, "all")) {
+			for (ss = 0; ss < _TLOG_NUM; ss++)
+				tetra_log_level[ss] = level;
+			continue;
+		}
+
+		ss = get_string_value(subsys_names, tok);
+		if (ss < 0) {
+			rc = -EINVAL;
+			break;
+		}
+		tetra_log_level[ss] = level;
+	}
+
+	free(dup);
+	return rc;
+}
+
+static void ring_write(struct tlog_ring *r, uint32_t pos, const void *data, uint32_t len)
+{
+	uint32_t off = pos & (TLOG_RING_SIZE - 1);
+	uint32_t first = len < TLOG_RING_SIZE - off ? len : TLOG_RING_SIZE - off;
+
+	memcpy(r->buf + off, data, first);
+	memcpy(r->buf, (const uint8_t *) data + first, len - first);
+}
+
+static void ring_read(struct tlog_ring *r, uint32_t pos, void *data, uint32_t len)
+{
+	uint32_t off = pos & (TLOG_RING_SIZE - 1);
+	uint32_t first = len < TLOG_RING_SIZE - off ? len : TLOG_RING_SIZE - off;
+
+	memcpy(data, r->buf + off, first);
+	memcpy((uint8_t *) data + first, r->buf, len - first);
+}
+
+static void ring_put(struct tlog_ring *r, int err, const char *msg, uint16_t len)
+{
+	uint8_t hdr[TLOG_HDR_LEN] = { len & 0xff, len >> 8, err, len && msg[len-1] == '\n' };
+	uint32_t head = r->head;
+
+	/* the writer thread only ever falls behind on a burst of output,
+	 * so waiting beats dropping lines the user asked for */
+	while (TLOG_RING_SIZE - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+	       < TLOG_HDR_LEN + len)
+		sched_yield();
+
+	ring_write(r, head, hdr, TLOG_HDR_LEN);
+	ring_write(r, head + TLOG_HDR_LEN, msg, len);
+	__atomic_store_n(&r->head, head + TLOG_HDR_LEN + len, __ATOMIC_RELEASE);
+}
+
+/* the ring of the calling thread, created on its first message */
+static struct tlog_ring *my_ring(void)
+{
+	struct tlog_ring *r = tlog_my_ring;
+
+	if (r)
+		return r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	r->next = __atomic_load_n(&tlog_rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&tlog_rings, &r->next, r, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	tlog_my_ring = r;
+
+	return r;
+}
+
+/* Copy a formatted message to 'out', starting each of its lines with the
+ * context of the calling thread.  Returns the length, clipped to 'size'. */
+static int tlog_add_ctx(char *out, int size, const char *in, int len)
+{
+	int clen = strlen(tlog_ctx), o = 0, i;
+
+	for (i = 0; i < len && o < size; i++) {
+		if (!tlog_mid_line) {
+			if (o + clen >= size)
+				break;
+			memcpy(out + o, tlog_ctx, clen);
+			o += clen;
+		}
+		out[o++] = in[i];
+		tlog_mid_line = in[i] != '\n';
+	}
+
+	return o;
+}
+
+void tetra_log_printf(int level, const char *fmt, ...)
+{
+	int err = level >= TLOGL_NOTICE;
+	struct tlog_ring *r = NULL;
+	char buf[TLOG_MSG_MAX], msg[TLOG_MSG_MAX];
+	va_list ap;
+	int len;
+
+	if (tlog_running)
+		r = my_ring();
+
+	va_start(ap, fmt);
+	if (!r && !tlog_ctx) {
+		vfprintf(err ? stderr : stdout, fmt, ap);
+		va_end(ap);
+		return;
+	}
+	len = vsnprintf(tlog_ctx ? buf : msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+		return;
+	if (len >= (int) sizeof(msg))
+		len = sizeof(msg) - 1;
+	if (tlog_ctx)
+		len = tlog_add_ctx(msg, sizeof(msg) - 1, buf, len);
+
+	if (!r) {
+		fwrite(msg, 1, len, err ? stderr : stdout);
+		return;
+	}
+	ring_put(r, err, msg, len);
+}
+
+/* Write out the records of a ring.  Lines are often assembled from
+ * several messages, so unless 'all' is set only complete lines are
+ * taken, which keeps the output of concurrent decoders from mixing
+ * within a line.  Returns the number of records written. */
+static int ring_drain(struct tlog_ring *r, int all)
+{
+	uint32_t tail = r->tail, end = tail, pos = tail;
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint8_t hdr[TLOG_HDR_LEN];
+	char msg[TLOG_MSG_MAX];
+	int count = 0;
+
+	while (pos != head) {
+		ring_read(r, pos, hdr, TLOG_HDR_LEN);
+		pos += TLOG_HDR_LEN + (hdr[0] | (hdr[1] << 8));
+		if (all || hdr[3])
+			end = pos;
+	}
+
+	while (tail != end) {
+		uint16_t len;
+
+		ring_read(r, tail, hdr, TLOG_HDR_LEN);
+		len = hdr[0] | (hdr[1] << 8);
+		ring_read(r, tail + TLOG_HDR_LEN, msg, len);
+		tail += TLOG_HDR_LEN + len;
+		__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+		fwrite(msg, 1, len, hdr[2] ? stderr : stdout);
+		count++;
+	}
+
+	return count;
+}
+
+static void *tlog_writer(void *arg)
+{
+	struct timespec idle = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+	while (1) {
+		int stopping = __atomic_load_n(&tlog_stopping, __ATOMIC_ACQUIRE);
+		struct tlog_ring *r;
+		int count = 0;
+
+		for (r = __atomic_load_n(&tlog_rings, __ATOMIC_ACQUIRE); r; r = r->next)
+			count += ring_drain(r, stopping);
+
+		if (!count) {
+			/* the producers are done once stopping is set, so the
+			 * pass above has taken everything */
+			if (stopping)
+				break;
+			fflush(stdout);
+			nanosleep(&idle, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+int tetra_log_start(void)
+{
+	int rc;
+
+	if (tlog_running)
+		return 0;
+
+	tlog_stopping = 0;
+	rc = pthread_create(&tlog_thread, NULL, tlog_writer, NULL);
+	if (rc)
+		return -rc;
+	tlog_running = 1;
+
+	return 0;
+}
+
+/* must only be called once no other thread logs any more; the rings stay
+ * allocated for a later tetra_log_start() */
+void tetra_log_stop(void)
+{
+	if (!tlog_running)
+		return;
+
+	__atomic_store_n(&tlog_stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(tlog_thread, NULL);
+	tlog_running = 0;
+
+	fflush(stdout);
+}
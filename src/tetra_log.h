@@ -0,0 +1,66 @@
+#ifndef TETRA_LOG_H
+#define TETRA_LOG_H
+/* Decoder logging with per-subsystem levels */
+
+#include <stdint.h>
+
+enum tetra_log_subsys {
+	TLOG_DEFAULT,
+	TLOG_PHY,
+	TLOG_LMAC,
+	TLOG_UMAC,
+	TLOG_LLC,
+	_TLOG_NUM
+};
+
+enum tetra_log_level {
+	TLOGL_DEBUG	= 1,
+	TLOGL_INFO	= 3,
+	TLOGL_NOTICE	= 5,	/* NOTICE and above go to stderr */
+	TLOGL_ERROR	= 7,
+	TLOGL_OFF	= 8,
+};
+
+/* Messages below this level are compiled out.  By default debug output
+ * is only built in with -DDEBUG, just like DEBUGP() used to be. */
+#ifndef TETRA_LOG_MIN_LEVEL
+#ifdef DEBUG
+#define TETRA_LOG_MIN_LEVEL	TLOGL_DEBUG
+#else
+#define TETRA_LOG_MIN_LEVEL	TLOGL_INFO
+#endif
+#endif
+
+extern uint8_t tetra_log_level[_TLOG_NUM];
+
+#define TLOG_ENABLED(ss, level) \
+	((level) >= TETRA_LOG_MIN_LEVEL && (level) >= tetra_log_level[ss])
+
+/* The arguments are only evaluated for enabled messages, so expensive
+ * helpers like osmo_ubit_dump() may be passed directly. */
+#define TLOGP(ss, level, fmt, args...) do {				\
+		if (TLOG_ENABLED(ss, level))				\
+			tetra_log_printf(level, fmt, ## args);		\
+	} while (0)
+
+void tetra_log_printf(int level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+void tetra_log_set_level(enum tetra_log_subsys ss, int level);
+
+/* Start every line the calling thread logs from now on with 'ctx', e.g.
+ * "ch3: " for the decoder of one channel among many; NULL for none.  The
+ * string must stay valid while it is set. */
+void tetra_log_set_context(const char *ctx);
+
+/* Parse a comma separated list like "all=notice,lmac=info" */
+int tetra_log_parse_levels(const char *spec);
+
+/* Hand the output to a writer thread; until this is called (and after
+ * tetra_log_stop()) messages are written synchronously */
+int tetra_log_start(void);
+
+/* Drain all pending messages and stop the writer thread */
+void tetra_log_stop(void);
+
+#endif /* TETRA_LOG_H */
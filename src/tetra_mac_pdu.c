@@ -414,7 +414,7 @@ const char *tetra_get_alloc_t_name(uint8_t alloct)
 
 const char *tetra_addr_dump(const struct tetra_addr *addr)
 {
-	static char buf[64];
+	static __thread char buf[64];
 	char *cur = buf;
 
 	memset(buf, 0, sizeof(buf));
@@ -0,0 +1,88 @@
+/* Pool of UNITDATA primitives between the lower and upper MAC */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+
+#include "tetra_prim.h"
+
+#define POOL_ALL	((1U << TETRA_PRIM_POOL_SIZE) - 1)
+
+void tetra_prim_pool_init(struct tetra_prim_pool *pool)
+{
+	pool->free_mask = POOL_ALL;
+}
+
+static struct tetra_prim_slot *pool_slot(struct tetra_prim_pool *pool,
+					 struct osmo_prim_hdr *oph)
+{
+	uintptr_t p = (uintptr_t) oph, first = (uintptr_t) &pool->slot[0];
+
+	if (p < first || p >= first + sizeof(pool->slot))
+		return NULL;
+
+	return &pool->slot[(p - first) / sizeof(pool->slot[0])];
+}
+
+struct tetra_tmvsap_prim *tetra_prim_alloc(struct tetra_prim_pool *pool,
+					    uint16_t prim, uint8_t op)
+{
+	struct tetra_tmvsap_prim *ttp;
+
+	if (pool->free_mask) {
+		unsigned int i = __builtin_ctz(pool->free_mask);
+		struct tetra_prim_slot *slot = &pool->slot[i];
+		struct msgb *msg = (struct msgb *) slot->msg_buf;
+
+		pool->free_mask &= ~(1U << i);
+
+		memset(&slot->prim, 0, sizeof(slot->prim));
+		ttp = &slot->prim.tmv;
+
+		/* what msgb_alloc() would have set up, without the heap */
+		memset(msg, 0, sizeof(*msg));
+		msg->data_len = TETRA_MAC_BLOCK_MAX;
+		msgb_reset(msg);
+		ttp->oph.msg = msg;
+	} else {
+		ttp = talloc_zero(NULL, struct tetra_tmvsap_prim);
+		ttp->oph.msg = msgb_alloc(TETRA_MAC_BLOCK_MAX, "tmvsap_prim");
+	}
+
+	ttp->oph.sap = TETRA_SAP_TMV;
+	ttp->oph.primitive = prim;
+	ttp->oph.operation = op;
+
+	return ttp;
+}
+
+void tetra_prim_free(struct tetra_prim_pool *pool, struct osmo_prim_hdr *oph)
+{
+	struct tetra_prim_slot *slot = pool_slot(pool, oph);
+
+	if (slot) {
+		pool->free_mask |= 1U << (slot - pool->slot);
+		return;
+	}
+
+	talloc_free(oph->msg);
+	talloc_free(oph);
+}
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include <osmocom/core/prim.h>
+#include <osmocom/core/msgb.h>
 
 #include "tetra_common.h"
 
@@ -64,4 +65,35 @@ struct tetra_dmvsap_prim {
 	} u;
 };
 
+/* maximum number of type-1 bits of a MAC block, which is what the msgb of
+ * a UNITDATA primitive carries */
+#define TETRA_MAC_BLOCK_MAX	412
+
+/* A UNITDATA primitive with the storage of its msgb */
+struct tetra_prim_slot {
+	union {
+		struct tetra_tmvsap_prim tmv;
+		struct tetra_dmvsap_prim dmv;
+	} prim;
+	uint8_t msg_buf[sizeof(struct msgb) + TETRA_MAC_BLOCK_MAX]
+		__attribute__((aligned(__alignof__(struct msgb))));
+};
+
+/* The lower MAC hands a block to the upper MAC and gets the primitive back
+ * before the next one, so a handful of slots keeps the receive path off
+ * the heap; should they ever run out, primitives come from talloc. */
+#define TETRA_PRIM_POOL_SIZE	4
+
+struct tetra_prim_pool {
+	struct tetra_prim_slot slot[TETRA_PRIM_POOL_SIZE];
+	uint32_t free_mask;
+};
+
+void tetra_prim_pool_init(struct tetra_prim_pool *pool);
+
+struct tetra_tmvsap_prim *tetra_prim_alloc(struct tetra_prim_pool *pool,
+					    uint16_t prim, uint8_t op);
+
+void tetra_prim_free(struct tetra_prim_pool *pool, struct osmo_prim_hdr *oph);
+
 #endif
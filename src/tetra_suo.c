@@ -0,0 +1,65 @@
+/* Input of suo frames into the burst synchronizer */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+
+#include <phy/tetra_burst_sync.h>
+
+#include "tetra_suo.h"
+
+int floats_to_sbits(const struct frame *in, int8_t *out, size_t maxlen)
+{
+	size_t len = in->m.len;
+	size_t i;
+
+	if (len > maxlen) len = maxlen;
+	// purkka: skip the first two bits
+	if (len < 2)
+		return 0;
+
+	for (i = 2; i < len; ++i) {
+		int sbit = 127 - in->data[i];
+
+		*out++ = sbit < -127 ? -127 : sbit;
+	}
+
+	return len - 2;
+}
+
+int tetra_suo_frame_in(struct tetra_rx_state *trs, const void *msg, size_t size)
+{
+	const struct frame *in = msg;
+	size_t maxlen = ENCODED_MAXLEN;
+	int8_t *sbits;
+	int len;
+
+	if (size < sizeof(struct frame))
+		return -EINVAL;
+	if (maxlen > size - sizeof(struct frame))
+		maxlen = size - sizeof(struct frame);
+
+	if (maxlen > in->m.len)
+		maxlen = in->m.len;
+
+	/* only make room for what floats_to_sbits() will write */
+	sbits = tetra_burst_sync_reserve_soft(trs, maxlen > 2 ? maxlen - 2 : 0);
+	len = floats_to_sbits(in, sbits, maxlen);
+	tetra_burst_sync_commit_soft(trs, len);
+
+	return len;
+}
@@ -0,0 +1,24 @@
+#ifndef TETRA_SUO_H
+#define TETRA_SUO_H
+/* Input of suo frames into the burst synchronizer */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "suo.h"
+
+#define ENCODED_MAXLEN 0x900
+
+/* Convert the soft symbols of a received frame (0..255, 128 being the
+ * decision threshold, larger values meaning 1) to soft bits */
+int floats_to_sbits(const struct frame *in, int8_t *out, size_t maxlen);
+
+struct tetra_rx_state;
+
+/* Pass the frame in a received message of 'size' bytes to the burst
+ * synchronizer, slicing it straight into the bit ring.  Messages too short
+ * for the frame they announce are cut, ones without a frame header are
+ * dropped.  Returns the number of bits or a negative error. */
+int tetra_suo_frame_in(struct tetra_rx_state *trs, const void *msg, size_t size);
+
+#endif /* TETRA_SUO_H */
@@ -86,7 +86,8 @@ void tetra_tdma_time_add_fn(struct tetra_tdma_time *tm, uint32_t fn_count)
 
 char *tetra_tdma_time_dump(const struct tetra_tdma_time *tm)
 {
-	static char buf[256];
+	/* per thread, decoders for different channels may run concurrently */
+	static __thread char buf[256];
 
 	snprintf(buf, sizeof(buf), "%02u/%02u/%u/%03u", tm->mn, tm->fn, tm->tn, tm->sn);
 
@@ -61,15 +61,15 @@ static void rx_bcast(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 				      sid.duplex_spacing,
 				      sid.reverse_operation);
 
-	printf("BNCH SYSINFO (DL %u Hz, UL %u Hz), service_details 0x%04x ",
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "BNCH SYSINFO (DL %u Hz, UL %u Hz), service_details 0x%04x ",
 		dl_freq, ul_freq, sid.mle_si.bs_service_details);
 	if (sid.cck_valid_no_hf)
-		printf("CCK ID %u", sid.cck_id);
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "CCK ID %u", sid.cck_id);
 	else
-		printf("Hyperframe %u", sid.hyperframe_number);
-	printf("\n");
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "Hyperframe %u", sid.hyperframe_number);
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "\n");
 	for (i = 0; i < 12; i++)
-		printf("\t%s: %u\n", tetra_get_bs_serv_det_name(1 << i),
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "\t%s: %u\n", tetra_get_bs_serv_det_name(1 << i),
 			sid.mle_si.bs_service_details & (1 << i) ? 1 : 0);
 
 	memcpy(&tms->last_sid, &sid, sizeof(sid));
@@ -77,7 +77,7 @@ static void rx_bcast(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 
 const char *tetra_alloc_dump(const struct tetra_chan_alloc_decoded *cad, struct tetra_mac_state *tms)
 {
-	static char buf[64];
+	static __thread char buf[64];
 	char *cur = buf;
 	unsigned int freq_band, freq_offset;
 
@@ -103,29 +103,29 @@ static int rx_tl_sdu(struct tetra_mac_state *tms, struct msgb *msg, unsigned int
 	uint8_t *bits = msg->l3h;
 	uint8_t mle_pdisc = bits_to_uint(bits, 3);
 
-	printf("TL-SDU(%s): %s", tetra_get_mle_pdisc_name(mle_pdisc),
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "TL-SDU(%s): %s", tetra_get_mle_pdisc_name(mle_pdisc),
 		osmo_ubit_dump(bits, len));
 	switch (mle_pdisc) {
 	case TMLE_PDISC_MM:
-		printf(" %s", tetra_get_mm_pdut_name(bits_to_uint(bits+3, 4), 0));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " %s", tetra_get_mm_pdut_name(bits_to_uint(bits+3, 4), 0));
 		break;
 	case TMLE_PDISC_CMCE:
-		printf(" %s", tetra_get_cmce_pdut_name(bits_to_uint(bits+3, 5), 0));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " %s", tetra_get_cmce_pdut_name(bits_to_uint(bits+3, 5), 0));
 		break;
 	case TMLE_PDISC_SNDCP:
-		printf(" %s", tetra_get_sndcp_pdut_name(bits_to_uint(bits+3, 4), 0));
-		printf(" NSAPI=%u PCOMP=%u, DCOMP=%u",
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " %s", tetra_get_sndcp_pdut_name(bits_to_uint(bits+3, 4), 0));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " NSAPI=%u PCOMP=%u, DCOMP=%u",
 			bits_to_uint(bits+3+4, 4),
 			bits_to_uint(bits+3+4+4, 4),
 			bits_to_uint(bits+3+4+4+4, 4));
-		printf(" V%u, IHL=%u",
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " V%u, IHL=%u",
 			bits_to_uint(bits+3+4+4+4+4, 4),
 			4*bits_to_uint(bits+3+4+4+4+4+4, 4));
-		printf(" Proto=%u",
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " Proto=%u",
 			bits_to_uint(bits+3+4+4+4+4+4+4+64, 8));
 		break;
 	case TMLE_PDISC_MLE:
-		printf(" %s", tetra_get_mle_pdut_name(bits_to_uint(bits+3, 3), 0));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, " %s", tetra_get_mle_pdut_name(bits_to_uint(bits+3, 3), 0));
 		break;
 	default:
 		break;
@@ -141,7 +141,7 @@ static int rx_tm_sdu(struct tetra_mac_state *tms, struct msgb *msg, unsigned int
 	memset(&lpp, 0, sizeof(lpp));
 	tetra_llc_pdu_parse(&lpp, bits, len);
 
-	printf("TM-SDU(%s,%u,%u): ",
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "TM-SDU(%s,%u,%u): ",
 		tetra_get_llc_pdut_dec_name(lpp.pdu_type), lpp.ns, lpp.ss);
 	if (lpp.tl_sdu && lpp.ss == 0) {
 		msg->l3h = lpp.tl_sdu;
@@ -160,7 +160,7 @@ static void rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 	tmpdu_offset = macpdu_decode_resource(&rsd, msg->l1h);
 	msg->l2h = msg->l1h + tmpdu_offset;
 
-	printf("RESOURCE Encr=%u, Length=%d Addr=%s ",
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "RESOURCE Encr=%u, Length=%d Addr=%s ",
 		rsd.encryption_mode, rsd.macpdu_length,
 		tetra_addr_dump(&rsd.addr));
 
@@ -168,10 +168,10 @@ static void rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 		goto out;
 
 	if (rsd.chan_alloc_pres)
-		printf("ChanAlloc=%s ", tetra_alloc_dump(&rsd.cad, tms));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "ChanAlloc=%s ", tetra_alloc_dump(&rsd.cad, tms));
 
 	if (rsd.slot_granting.pres)
-		printf("SlotGrant=%u/%u ", rsd.slot_granting.nr_slots,
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "SlotGrant=%u/%u ", rsd.slot_granting.nr_slots,
 			rsd.slot_granting.delay);
 
 	if (rsd.macpdu_length > 0 && rsd.encryption_mode == 0) {
@@ -184,7 +184,7 @@ static void rx_resrc(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 	tms->ssi = rsd.addr.ssi;
 
 out:
-	printf("\n");
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "\n");
 }
 
 static void rx_suppl(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
@@ -207,18 +207,18 @@ static void rx_suppl(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms
 	}
 #endif
 
-	printf("SUPPLEMENTARY MAC-D-BLOCK ");
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "SUPPLEMENTARY MAC-D-BLOCK ");
 
 	//if (sud.encryption_mode == 0)
 		msg->l2h = msg->l1h + tmpdu_offset;
 		rx_tm_sdu(tms, msg, 100);
 
-	printf("\n");
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "\n");
 }
 
 static void dump_access(struct tetra_access_field *acc, unsigned int num)
 {
-	printf("ACCESS%u: %c/%u ", num, 'A'+acc->access_code, acc->base_frame_len);
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "ACCESS%u: %c/%u ", num, 'A'+acc->access_code, acc->base_frame_len);
 }
 
 static void rx_aach(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
@@ -226,7 +226,7 @@ static void rx_aach(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 	struct tmv_unitdata_param *tup = &tmvp->u.unitdata;
 	struct tetra_acc_ass_decoded aad;
 
-	printf("ACCESS-ASSIGN PDU: ");
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "ACCESS-ASSIGN PDU: ");
 
 	memset(&aad, 0, sizeof(aad));
 	macpdu_decode_access_assign(&aad, tmvp->oph.msg->l1h,
@@ -237,9 +237,9 @@ static void rx_aach(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 	if (aad.pres & TETRA_ACC_ASS_PRES_ACCESS2)
 		dump_access(&aad.access[1], 2);
 	if (aad.pres & TETRA_ACC_ASS_PRES_DL_USAGE)
-		printf("DL_USAGE: %s ", tetra_get_dl_usage_name(aad.dl_usage));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "DL_USAGE: %s ", tetra_get_dl_usage_name(aad.dl_usage));
 	if (aad.pres & TETRA_ACC_ASS_PRES_UL_USAGE)
-		printf("UL_USAGE: %s ", tetra_get_ul_usage_name(aad.ul_usage));
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "UL_USAGE: %s ", tetra_get_ul_usage_name(aad.ul_usage));
 
 	/* save the state whether the current burst is traffic or not */
 	if (aad.dl_usage > 3)
@@ -247,7 +247,7 @@ static void rx_aach(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
 	else
 		tms->cur_burst.is_traffic = 0;
 
-	printf("\n");
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "\n");
 }
 
 static int rx_tmv_unitdata_ind(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_state *tms)
@@ -267,20 +267,28 @@ static int rx_tmv_unitdata_ind(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_
 		pdu_name = tetra_get_macpdu_name(pdu_type);
 	}
 
-	printf("TMV-UNITDATA.ind %s %s CRC=%u %s\n",
+	TLOGP(TLOG_UMAC, TLOGL_INFO, "TMV-UNITDATA.ind %s %s CRC=%u %s\n",
 		tetra_tdma_time_dump(&tup->tdma_time),
 		tetra_get_lchan_name(tup->lchan),
 		tup->crc_ok, pdu_name);
 
-	if (!tup->crc_ok)
+	if (!tup->crc_ok) {
+		/* without a trustworthy ACCESS-ASSIGN, the slot is not taken
+		 * for traffic */
+		if (tup->lchan == TETRA_LC_AACH)
+			tms->cur_burst.is_traffic = 0;
 		return 0;
+	}
 
-	gsmtap_msg = tetra_gsmtap_makemsg(&tup->tdma_time, tup->lchan,
-					  tup->tdma_time.tn,
-					  /* FIXME: */ 0, 0, 0,
-					msg->l1h, msgb_l1len(msg), tms);
-	if (gsmtap_msg)
-		tetra_gsmtap_sendmsg(gsmtap_msg);
+	tms->tsn = tup->tdma_time.tn;
+	if (tms->gsmtap) {
+		gsmtap_msg = tetra_gsmtap_makemsg(&tup->tdma_time, tup->lchan,
+						  tup->tdma_time.tn,
+						  /* FIXME: */ 0, 0, 0,
+						msg->l1h, msgb_l1len(msg), tms);
+		if (gsmtap_msg)
+			tetra_gsmtap_sendmsg(tms, gsmtap_msg);
+	}
 
 	switch (tup->lchan) {
 	case TETRA_LC_AACH:
@@ -301,22 +309,22 @@ static int rx_tmv_unitdata_ind(struct tetra_tmvsap_prim *tmvp, struct tetra_mac_
 			break;
 		case TETRA_PDU_T_MAC_FRAG_END:
 			if (msg->l1h[3] == TETRA_MAC_FRAGE_FRAG) {
-				printf("FRAG/END FRAG: ");
+				TLOGP(TLOG_UMAC, TLOGL_INFO, "FRAG/END FRAG: ");
 				msg->l2h = msg->l1h+4;
 				rx_tm_sdu(tms, msg, 100 /*FIXME*/);
-				printf("\n");
+				TLOGP(TLOG_UMAC, TLOGL_INFO, "\n");
 			} else
-				printf("FRAG/END END\n");
+				TLOGP(TLOG_UMAC, TLOGL_INFO, "FRAG/END END\n");
 			break;
 		default:
-			printf("STRANGE pdu=%u\n", pdu_type);
+			TLOGP(TLOG_UMAC, TLOGL_INFO, "STRANGE pdu=%u\n", pdu_type);
 			break;
 		}
 		break;
 	case TETRA_LC_BSCH:
 		break;
 	default:
-		printf("STRANGE lchan=%u\n", tup->lchan);
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "STRANGE lchan=%u\n", tup->lchan);
 		break;
 	}
 
@@ -335,12 +343,11 @@ int upper_mac_prim_recv(struct osmo_prim_hdr *op, void *priv)
 		rc = rx_tmv_unitdata_ind(tmvp, tms);
 		break;
 	default:
-		printf("primitive on unknown sap\n");
+		TLOGP(TLOG_UMAC, TLOGL_INFO, "primitive on unknown sap\n");
 		break;
 	}
 
-	talloc_free(op->msg);
-	talloc_free(op);
+	tetra_prim_free(tms->prim_pool, op);
 
 	return rc;
 }